@@ -0,0 +1,52 @@
+#ifndef BLOOM_FILTER_HPP
+#define BLOOM_FILTER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+class BloomFilter;
+
+// One filter per entry segment, keyed by segment id
+using SegmentFilters = std::map<std::uint32_t, BloomFilter>;
+
+// Blocked Bloom filter over the byte trigrams of entry text. All bits for a
+// trigram fall in one 64-byte block, so a probe touches one cache line.
+// Hashes are seeded from the user's key, so the filter bits say nothing
+// useful about entry text to someone without it. A keyword can only occur
+// in text containing all of its trigrams; keywords shorter than a trigram
+// always "may" match.
+class BloomFilter {
+private:
+    std::vector<std::uint64_t> words;
+    std::uint64_t seed;
+
+public:
+    static const size_t BlockWords = 8;      // 512 bits
+    static const size_t DefaultBlocks = 2048; // 128 KB
+
+    // Constructors
+    explicit BloomFilter(std::uint64_t seed = 0, size_t blocks = DefaultBlocks);
+
+    void addText(std::string_view text);
+    bool mayContain(std::string_view keyword) const;
+    // Adds every bit of `other`, built with the same seed and size
+    void merge(const BloomFilter& other);
+
+    static std::uint64_t seedFromKey(std::string_view key);
+
+    // Persistence, encrypted with the key the filters are seeded from; load
+    // fails if the file was written at another store generation or with
+    // another key
+    static bool save(const std::string& path, std::string_view key, std::uint64_t generation,
+                     const SegmentFilters& filters);
+    static bool load(const std::string& path, std::string_view key, std::uint64_t generation,
+                     SegmentFilters& filters);
+
+private:
+    std::uint64_t hashTrigram(const char* text) const;
+};
+
+#endif // BLOOM_FILTER_HPP
@@ -0,0 +1,80 @@
+#ifndef BODY_CACHE_HPP
+#define BODY_CACHE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Tracks which entry bodies are held decrypted in memory and picks the ones
+// to drop once their total size exceeds the budget. Ids are spread over
+// shards, each with its own lock, CLOCK hand and share of the budget, so
+// the parallel load path can admit bodies without contending on one mutex.
+// The cache only does the accounting; Diary owns the bodies themselves.
+class BodyCache {
+public:
+    struct Stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::uint64_t residentBytes;
+        std::uint64_t budgetBytes;
+    };
+
+    static const size_t DefaultBudget = 256 * 1024 * 1024;
+
+private:
+    struct Slot {
+        std::uint64_t id;
+        size_t bytes;
+        bool referenced;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Slot> ring;
+        std::unordered_map<std::uint64_t, size_t> positions; // Id -> index in ring
+        size_t hand = 0;
+        size_t bytes = 0;
+    };
+
+    static const size_t ShardCount = 16;
+
+    std::array<Shard, ShardCount> shards;
+    std::atomic<size_t> budget;
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> misses;
+    std::atomic<std::uint64_t> evictions;
+
+public:
+    // Constructors
+    explicit BodyCache(size_t budgetBytes = DefaultBudget);
+    BodyCache(const BodyCache&) = delete;
+    BodyCache& operator=(const BodyCache&) = delete;
+
+    // Lowering the budget evicts immediately; the dropped ids are returned
+    void setBudget(size_t budgetBytes, std::vector<std::uint64_t>& evicted);
+
+    // Counts a hit and marks the body recently used if it is resident
+    bool touch(std::uint64_t id);
+    bool contains(std::uint64_t id);
+    // Admits a body only if it fits without evicting anything (bulk loading)
+    bool admit(std::uint64_t id, size_t bytes);
+    // Admits or resizes a body, evicting others until back within budget.
+    // The body being inserted is never among the evicted.
+    void insert(std::uint64_t id, size_t bytes, std::vector<std::uint64_t>& evicted);
+    void erase(std::uint64_t id);
+    void clear();
+
+    Stats getStats();
+
+private:
+    Shard& shardFor(std::uint64_t id);
+    size_t shardBudget() const;
+    void evict(Shard& shard, std::uint64_t keep, std::vector<std::uint64_t>& evicted);
+    void removeAt(Shard& shard, size_t position);
+};
+
+#endif // BODY_CACHE_HPP
@@ -0,0 +1,170 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Lock-free bounded multi-producer/multi-consumer queue. Each slot carries a
+// sequence number telling producers and consumers whose turn it is, so a
+// push or pop is one compare-and-swap on the shared position plus a release
+// store on the slot. tryPush/tryPop never block; push/pop spin briefly and
+// then sleep until the other side makes room or data, or the queue closes.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keeps the producer and consumer positions on separate cache lines
+    static constexpr size_t kCacheLine = 64;
+    // Failed attempts before a blocking push or pop goes to sleep
+    static constexpr int kSpinLimit = 64;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(kCacheLine) std::atomic<size_t> pushPosition;
+    alignas(kCacheLine) std::atomic<size_t> popPosition;
+
+    // Only touched by threads that are about to sleep or must wake one
+    alignas(kCacheLine) std::atomic<size_t> sleepers;
+    std::atomic<bool> closed;
+    std::mutex parkMutex;
+    std::condition_variable parked;
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity)
+        : mask(0), pushPosition(0), popPosition(0), sleepers(0), closed(false) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool tryPush(T&& value) {
+        size_t position = pushPosition.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            auto lag = static_cast<std::ptrdiff_t>(slot.sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0) {
+                if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false; // Full
+            } else {
+                position = pushPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t position = popPosition.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            auto lag = static_cast<std::ptrdiff_t>(slot.sequence.load(std::memory_order_acquire) - (position + 1));
+            if (lag == 0) {
+                if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false; // Empty
+            } else {
+                position = popPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false, leaving value untouched, if the queue was closed first
+    bool push(T&& value) {
+        for (int attempt = 1;; ++attempt) {
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (tryPush(std::move(value))) {
+                wake();
+                return true;
+            }
+            if (attempt >= kSpinLimit) {
+                park([this] { return canPush(); });
+            }
+        }
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(T& value) {
+        for (int attempt = 1;; ++attempt) {
+            if (tryPop(value)) {
+                wake();
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire)) {
+                return tryPop(value); // Pushes that finished before the close are still delivered
+            }
+            if (attempt >= kSpinLimit) {
+                park([this] { return canPop(); });
+            }
+        }
+    }
+
+    // Fails later pushes and wakes every sleeper. Producers close the queue
+    // once they are done; anyone may close it early to abandon the rest.
+    void close() {
+        closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(parkMutex);
+        parked.notify_all();
+    }
+
+private:
+    bool canPush() const {
+        size_t position = pushPosition.load(std::memory_order_relaxed);
+        return slots[position & mask].sequence.load(std::memory_order_acquire) == position;
+    }
+
+    bool canPop() const {
+        size_t position = popPosition.load(std::memory_order_relaxed);
+        return slots[position & mask].sequence.load(std::memory_order_acquire) == position + 1;
+    }
+
+    // A sleeper registers before its last check and a waker publishes before
+    // reading the count, with a fence on each side, so either the check sees
+    // the change or the waker sees the sleeper and notifies it under the lock
+    template <typename Ready>
+    void park(Ready ready) {
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(parkMutex);
+            parked.wait(lock, [&] { return closed.load(std::memory_order_acquire) || ready(); });
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            parked.notify_all();
+        }
+    }
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,68 @@
+#ifndef CHUNK_STORE_HPP
+#define CHUNK_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <mutex>
+#include "SegmentStore.hpp"
+#include "Compression.hpp"
+
+// Content-addressed store for entry bodies. Bodies are split at
+// content-defined boundaries so text shared between entries (templates,
+// checklists) produces identical chunks, each stored once and reference
+// counted by the entries whose chunk lists name it.
+class ChunkStore {
+private:
+    struct Chunk {
+        std::uint64_t recordId;
+        std::uint32_t size;
+        std::uint32_t refCount;
+    };
+
+    SegmentStore store;
+    const Compression::Dictionaries& dictionaries;
+    std::unordered_map<std::string, Chunk> chunks;
+    std::unordered_map<std::uint64_t, std::vector<std::string>> manifests;
+    std::unordered_set<std::string> unreferenced; // Chunks whose count reached 0 since the last collection
+    mutable std::mutex mutex;
+
+public:
+    // Constructors
+    ChunkStore(const std::string& directory, const Compression::Dictionaries& dictionaries);
+
+    // Lifecycle
+    bool open();
+    void close();
+    void startCompactor();
+
+    // Chunk lists. assign writes the chunks of a body and holds a reference
+    // on each for the caller; once the record naming them is durable, commit
+    // makes them the entry's list and drops the old one. abandon undoes an
+    // assign whose record was never written, retain keeps both lists when
+    // that is unknown.
+    bool assign(std::string_view content, std::string_view key, std::vector<std::string>& hashes);
+    void commit(std::uint64_t entryId, const std::vector<std::string>& hashes);
+    void abandon(const std::vector<std::string>& hashes);
+    void retain(std::uint64_t entryId, const std::vector<std::string>& hashes);
+    void adopt(std::uint64_t entryId, const std::vector<std::string>& hashes);
+    void release(std::uint64_t entryId);
+    bool assemble(const std::vector<std::string>& hashes, std::string_view key, SecureString& content) const;
+    bool collectGarbage();
+
+    // Statistics
+    std::uint64_t getUniqueBytes() const;
+    std::uint64_t getReferencedBytes() const;
+
+    // Content-defined chunking
+    static std::vector<std::string_view> split(std::string_view content);
+
+private:
+    void releaseLocked(std::uint64_t entryId);
+    void unreferenceLocked(const std::string& hash);
+};
+
+#endif // CHUNK_STORE_HPP
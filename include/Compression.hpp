@@ -0,0 +1,65 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "SecureMemory.hpp"
+
+class Compression {
+public:
+    // Codec ids are persisted with each entry; never renumber them
+    enum Codec : std::uint8_t {
+        None = 0,
+        Builtin = 1,   // LZ77 block codec, always available
+        Zstd = 2,
+        Lz4 = 3
+    };
+
+    // Trained dictionaries by id, and the one new data is compressed with.
+    // Each Diary keeps its own, so a dictionary built from one user's text
+    // never reaches another user's entries. Views returned by find stay
+    // valid until clear(), which is only called while nothing is being
+    // compressed (login and logout).
+    class Dictionaries {
+    private:
+        mutable std::mutex mutex;
+        std::map<std::uint32_t, SecureString> dictionaries;
+        std::atomic<std::uint32_t> active{0};
+
+    public:
+        std::uint32_t add(std::string_view dictionary); // Returns the id, 0 if empty
+        bool find(std::uint32_t id, std::string_view& dictionary) const;
+        void setActive(std::uint32_t id);
+        std::uint32_t getActive() const;
+        void clear();
+    };
+
+    // Codec selection
+    static bool isAvailable(Codec codec);
+    static Codec getDefaultCodec();
+    static void setDefaultCodec(Codec codec);
+
+    // Returns the codec actually used, None if compression did not pay off.
+    // Without dictionaries, data is compressed without one and data that
+    // needs one cannot be decompressed. Compressed text is as sensitive as
+    // the text itself, so both directions write into secure memory.
+    static Codec compress(std::string_view data, Codec codec, SecureString& compressed,
+                          const Dictionaries* dictionaries = nullptr);
+    static bool decompress(std::string_view compressed, Codec codec, SecureString& data,
+                           const Dictionaries* dictionaries = nullptr);
+
+    // Dictionary support
+    static SecureString trainDictionary(const std::vector<std::string_view>& samples, size_t maxSize);
+
+private:
+    static SecureString builtinCompress(std::string_view data, std::string_view dictionary);
+    static bool builtinDecompress(const char* data, size_t length, std::string_view dictionary,
+                                  size_t rawLength, SecureString& out);
+};
+
+#endif // COMPRESSION_HPP
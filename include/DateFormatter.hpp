@@ -0,0 +1,19 @@
+#ifndef DATE_FORMATTER_HPP
+#define DATE_FORMATTER_HPP
+
+#include <ctime>
+#include <cstddef>
+
+// Thread-safe "YYYY-MM-DD HH:MM:SS" formatting of local times. The date
+// part is cached per thread for the current day; the time of day is
+// derived arithmetically, so listings avoid localtime and stream overhead.
+class DateFormatter {
+public:
+    static const size_t BufferSize = 20; // Including the terminating NUL
+
+    // Returns the number of characters written, 0 if the buffer is too small
+    static size_t format(std::time_t time, char* buffer, size_t size);
+    static bool toLocalTime(std::time_t time, std::tm& result);
+};
+
+#endif // DATE_FORMATTER_HPP
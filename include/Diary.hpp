@@ -4,14 +4,46 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include "Entry.hpp"
 #include "User.hpp"
+#include "SegmentStore.hpp"
+#include "ChunkStore.hpp"
+#include "IndexSnapshot.hpp"
+#include "BloomFilter.hpp"
+#include "BodyCache.hpp"
+#include "RevisionStore.hpp"
+#include "Compression.hpp"
+
+// Position in the timestamp-ordered listing, advanced by Diary::nextPage
+struct EntryCursor {
+    std::time_t timestamp = 0;
+    std::uint64_t id = 0;
+    bool started = false;
+};
 
 class Diary {
 private:
     std::shared_ptr<User> currentUser;
     std::vector<Entry> entries;
+    TimeIndex timeIndex;
+    TagIndex tagIndex;
+    SegmentFilters segmentFilters; // Keyword filters over the entries in each store segment
+    // The segment whose filter covers each entry's current text, and the
+    // entries each segment covers, so a search passes over whole segments
+    std::unordered_map<std::uint64_t, std::uint32_t> entrySegments;
+    std::map<std::uint32_t, std::unordered_set<std::uint64_t>> segmentEntries;
+    std::unordered_map<std::uint64_t, size_t> idIndex; // Entry id -> position in entries
     std::string storageDirectory;
+    Compression::Dictionaries dictionaries; // The current user's, by id
+    std::unique_ptr<SegmentStore> store;
+    std::unique_ptr<ChunkStore> chunkStore;
+    std::unique_ptr<RevisionStore> revisionStore;
+    // Which decrypted bodies stay in memory; the rest are read back from
+    // the store when needed
+    mutable BodyCache bodyCache;
 
 public:
     // Constructors
@@ -29,6 +61,12 @@ public:
     bool updateEntry(const std::string& title, const Entry& newEntry);
     Entry* getEntry(const std::string& title);
     std::vector<Entry> getAllEntries() const;
+    size_t getEntryCount() const;
+    bool nextPage(EntryCursor& cursor, size_t pageSize, std::vector<Entry>& page) const;
+    
+    // Revision history: the versions an entry had before each update, oldest first
+    std::vector<RevisionStore::Revision> listRevisions(const std::string& title) const;
+    bool getRevision(const std::string& title, std::uint32_t number, Entry& revision) const;
     
     // Search functionality
     std::vector<Entry> searchByDate(const std::time_t& date);
@@ -38,12 +76,44 @@ public:
     // Storage management
     bool saveToFile() const;
     bool loadFromFile();
+    bool trainCompressionDictionary();
+    
+    // Memory management
+    void setMemoryBudget(size_t bytes);
+    BodyCache::Stats getCacheStats() const;
 
 private:
     std::string getUserFilePath() const;
     std::string getEntriesFilePath() const;
-    void encryptEntries();
-    void decryptEntries();
+    std::string getSegmentsDirectory() const;
+    std::string getChunksDirectory() const;
+    std::string getRevisionsDirectory() const;
+    std::string getDictionaryDirectory() const;
+    std::string getIndexSnapshotPath() const;
+    std::string getSegmentFiltersPath() const;
+    void loadDictionaries();
+    bool loadUser();
+    bool loadEntries();
+    bool scanEntries(bool buildFilters);
+    bool persistEntry(const Entry& entry);
+    bool importLegacyEntries();
+    void indexEntry(const Entry& entry);
+    void unindexEntry(const Entry& entry);
+    void rebuildIndexes();
+    bool restoreIndexes();
+    void filterEntry(const Entry& entry);
+    std::uint32_t addToFilter(SegmentFilters& filters, const Entry& entry, std::string_view key) const;
+    void placeEntry(std::uint64_t id, std::uint32_t segment);
+    void unplaceEntry(std::uint64_t id);
+    bool loadSegmentFilters();
+    bool decryptEntry(Entry& entry, std::string_view key, SecureString& content) const;
+    bool isPinned(const Entry& entry) const;
+    void admitBody(Entry& entry);
+    void cacheBody(const Entry& entry);
+    void dropBodies(const std::vector<std::uint64_t>& ids);
+    bool loadBody(const Entry& entry, SecureString& content) const;
+    void fillBody(Entry& copy) const;
+    bool ensureResident(Entry& entry);
 };
 
 #endif // DIARY_HPP 
\ No newline at end of file
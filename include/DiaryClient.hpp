@@ -0,0 +1,63 @@
+#ifndef DIARY_CLIENT_HPP
+#define DIARY_CLIENT_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Diary.hpp"
+#include "Protocol.hpp"
+
+// Thin client for DiaryServer. Mirrors the parts of the Diary interface the
+// interactive front end uses, so either can drive the same menu loop.
+class DiaryClient {
+private:
+    int fd;
+    std::uint32_t nextRequestId;
+    std::string input;
+    Entry fetchedEntry; // Backs the pointer returned by getEntry
+
+    // Next page requested ahead of time while the current one is displayed
+    bool prefetchPending;
+    std::uint32_t prefetchRequest;
+    EntryCursor prefetchCursor;
+    size_t prefetchSize;
+
+public:
+    // Constructors
+    DiaryClient();
+    ~DiaryClient();
+    DiaryClient(const DiaryClient&) = delete;
+    DiaryClient& operator=(const DiaryClient&) = delete;
+
+    // Connection
+    bool connect(const std::string& socketPath);
+    bool isConnected() const;
+
+    // Pipelining: submit any number of requests, then collect responses
+    std::uint32_t submit(Protocol::Opcode opcode, const std::string& body);
+    bool receive(std::uint32_t requestId, Protocol::Frame& response);
+
+    // User management
+    bool registerUser(const std::string& username, const std::string& password);
+    bool loginUser(const std::string& username, const std::string& password);
+    void logoutUser();
+
+    // Entry management
+    bool addEntry(const Entry& entry);
+    bool deleteEntry(const std::string& title);
+    bool updateEntry(const std::string& title, const Entry& newEntry);
+    Entry* getEntry(const std::string& title);
+    bool nextPage(EntryCursor& cursor, size_t pageSize, std::vector<Entry>& page);
+
+    // Search functionality
+    std::vector<Entry> searchByDate(const std::time_t& date);
+    std::vector<Entry> searchByKeyword(const std::string& keyword);
+    std::vector<Entry> searchByTag(const std::string& tag);
+
+private:
+    bool call(Protocol::Opcode opcode, const std::string& body, Protocol::Frame& response);
+    std::vector<Entry> search(Protocol::Opcode opcode, const std::string& body);
+    std::uint32_t submitPage(const EntryCursor& cursor, size_t pageSize);
+};
+
+#endif // DIARY_CLIENT_HPP
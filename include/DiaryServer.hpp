@@ -0,0 +1,58 @@
+#ifndef DIARY_SERVER_HPP
+#define DIARY_SERVER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include "Diary.hpp"
+#include "Protocol.hpp"
+
+// Long-running daemon that keeps a Diary loaded and decrypted between
+// client sessions and serves it over a Unix domain socket. Single-threaded
+// epoll loop; each connection may pipeline requests. The diary is logged
+// out (and its decrypted state dropped) after an idle timeout.
+class DiaryServer {
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        bool authenticated;
+    };
+
+    Diary& diary;
+    std::string socketPath;
+    int listenFd;
+    int epollFd;
+    std::unordered_map<int, Connection> connections;
+    std::atomic<bool> running;
+    std::chrono::seconds idleTimeout;
+    std::chrono::steady_clock::time_point lastActivity;
+    bool warm;
+
+public:
+    // Constructors
+    DiaryServer(Diary& diary, const std::string& socketPath);
+    ~DiaryServer();
+    DiaryServer(const DiaryServer&) = delete;
+    DiaryServer& operator=(const DiaryServer&) = delete;
+
+    // Lifecycle
+    bool start();
+    void run();
+    void stop();
+    void setIdleTimeout(std::chrono::seconds timeout);
+
+private:
+    void acceptConnections();
+    bool readInput(Connection& connection);
+    bool processRequests(Connection& connection);
+    bool flush(Connection& connection);
+    void updateInterest(Connection& connection);
+    void closeConnection(int fd);
+    Protocol::Status dispatch(Connection& connection, const Protocol::Frame& request, std::string& body);
+    void evictIfIdle();
+};
+
+#endif // DIARY_SERVER_HPP
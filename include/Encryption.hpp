@@ -2,26 +2,31 @@
 #define ENCRYPTION_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "SecureMemory.hpp"
 
 class Encryption {
 public:
-    // Basic encryption/decryption using XOR with key
-    static std::string encrypt(const std::string& data, const std::string& key);
-    static std::string decrypt(const std::string& encryptedData, const std::string& key);
+    // Basic encryption/decryption using XOR with key; plaintext comes back
+    // in secure memory
+    static std::string encrypt(std::string_view data, std::string_view key);
+    static SecureString decrypt(std::string_view encryptedData, std::string_view key);
     
     // Password hashing
-    static std::string hashString(const std::string& input);
+    static std::string hashString(std::string_view input);
     
     // Key generation
     static std::string generateKey(const std::string& seed);
     
     // Utility functions
     static std::string base64Encode(const std::vector<unsigned char>& data);
-    static std::vector<unsigned char> base64Decode(const std::string& encoded);
+    static std::vector<unsigned char> base64Decode(std::string_view encoded);
+    static std::uint32_t crc32(const char* data, size_t length);
 
 private:
-    static std::string padKey(const std::string& key, size_t length);
     static unsigned char getRandom();
 };
 
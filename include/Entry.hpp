@@ -1,16 +1,24 @@
 #ifndef ENTRY_HPP
 #define ENTRY_HPP
 
+#include "SecureMemory.hpp"
+#include "Compression.hpp"
 #include <string>
+#include <string_view>
+#include <vector>
 #include <ctime>
+#include <cstdint>
 
 class Entry {
 private:
     std::string title;
-    std::string content;
+    SecureString content; // Pooled in locked memory while decrypted
     std::time_t timestamp;
     std::string tags;
     bool encrypted;
+    std::uint64_t id; // Storage record id, assigned by Diary
+    std::uint8_t codec; // Compression::Codec applied before encryption
+    std::vector<std::string> chunks; // ChunkStore hashes when the body is stored by reference
 
 public:
     // Constructors
@@ -19,24 +27,31 @@ public:
     
     // Getters
     std::string getTitle() const;
-    std::string getContent() const;
+    std::string_view getContent() const; // Valid until the entry changes
     std::time_t getTimestamp() const;
     std::string getTags() const;
     bool isEncrypted() const;
+    std::uint64_t getId() const;
+    std::uint8_t getCodec() const;
+    const std::vector<std::string>& getChunks() const;
     
     // Setters
     void setTitle(const std::string& title);
-    void setContent(const std::string& content);
+    void setContent(std::string_view content);
     void setTags(const std::string& tags);
+    void setId(std::uint64_t id);
+    void setChunks(const std::vector<std::string>& chunks);
     
     // Utility functions
-    void encrypt(const std::string& key);
-    void decrypt(const std::string& key);
+    void encrypt(std::string_view key, const Compression::Dictionaries* dictionaries = nullptr);
+    void decrypt(std::string_view key, const Compression::Dictionaries* dictionaries = nullptr);
+    void releaseContent(); // Drops the body and its buffer, e.g. when evicted from memory
     std::string getFormattedDate() const;
+    size_t formatDate(char* buffer, size_t size) const;
     
     // Serialization
     std::string serialize() const;
-    static Entry deserialize(const std::string& data);
+    static Entry deserialize(std::string_view data);
 };
 
 #endif // ENTRY_HPP 
\ No newline at end of file
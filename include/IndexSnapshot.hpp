@@ -0,0 +1,32 @@
+#ifndef INDEX_SNAPSHOT_HPP
+#define INDEX_SNAPSHOT_HPP
+
+#include <string>
+#include <string_view>
+#include <set>
+#include <map>
+#include <ctime>
+#include <cstdint>
+
+// Entries in timestamp order, ties broken by entry id
+using TimeIndex = std::set<std::pair<std::time_t, std::uint64_t>>;
+// Distinct tag strings and the ids of the entries carrying them
+using TagIndex = std::map<std::string, std::set<std::uint64_t>>;
+
+// Diary search indexes saved between sessions. A snapshot records the store
+// generation it was taken at and is only loaded back at that same
+// generation, so any later write (or a crash before the next save) makes it
+// stale and the indexes are rebuilt from the entries instead.
+class IndexSnapshot {
+public:
+    static const std::uint32_t Version = 1;
+
+    static bool save(const std::string& path, std::string_view key, std::uint64_t generation,
+                     const TimeIndex& timeIndex, const TagIndex& tagIndex);
+    // Fails without touching the indexes if the file is missing, corrupt,
+    // from another version or taken at a different generation
+    static bool load(const std::string& path, std::string_view key, std::uint64_t generation,
+                     TimeIndex& timeIndex, TagIndex& tagIndex);
+};
+
+#endif // INDEX_SNAPSHOT_HPP
@@ -0,0 +1,75 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Entry.hpp"
+
+// Binary request/response framing shared by DiaryServer and DiaryClient.
+// Frame: u32 body length | u8 opcode or status | u32 request id | body
+// Integers are little endian, strings are u32 length + bytes. Requests may
+// be pipelined; responses come back in request order.
+class Protocol {
+public:
+    enum Opcode : std::uint8_t {
+        Register = 1,
+        Login,
+        Logout,
+        AddEntry,
+        UpdateEntry,
+        DeleteEntry,
+        GetEntry,
+        NextPage,
+        SearchByDate,
+        SearchByKeyword,
+        SearchByTag
+    };
+
+    enum Status : std::uint8_t {
+        Ok = 0,
+        Failed,
+        Unauthorized,
+        BadRequest
+    };
+
+    struct Frame {
+        std::uint8_t code;
+        std::uint32_t requestId;
+        std::string body;
+    };
+
+    // Sequential decoder over a frame body
+    class Reader {
+    private:
+        const std::string& data;
+        size_t pos;
+
+    public:
+        explicit Reader(const std::string& data);
+        bool readU32(std::uint32_t& value);
+        bool readU64(std::uint64_t& value);
+        bool readString(std::string& value);
+        bool readEntry(Entry& entry);
+        bool readEntries(std::vector<Entry>& entries);
+    };
+
+    static const size_t HeaderSize = 9;
+    static const std::uint32_t MaxBodySize = 64 * 1024 * 1024;
+
+    // Framing
+    static void appendFrame(std::string& out, std::uint8_t code, std::uint32_t requestId,
+                            const std::string& body);
+    // Returns true and advances `offset` when a whole frame is buffered;
+    // sets `malformed` if the stream cannot be a valid frame sequence
+    static bool extractFrame(const std::string& in, size_t& offset, Frame& frame, bool& malformed);
+
+    // Body encoding
+    static void writeU32(std::string& out, std::uint32_t value);
+    static void writeU64(std::string& out, std::uint64_t value);
+    static void writeString(std::string& out, const std::string& value);
+    static void writeEntry(std::string& out, const Entry& entry);
+    static void writeEntries(std::string& out, const std::vector<Entry>& entries);
+};
+
+#endif // PROTOCOL_HPP
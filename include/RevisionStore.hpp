@@ -0,0 +1,70 @@
+#ifndef REVISION_STORE_HPP
+#define REVISION_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include "Entry.hpp"
+#include "Compression.hpp"
+#include "SegmentStore.hpp"
+
+// Earlier versions of entries. Each update appends the version it replaces
+// as a binary delta against the revision before it; a revision is stored
+// whole (a keyframe) at least every KeyframeInterval revisions, so reading
+// any of them applies at most KeyframeInterval - 1 deltas.
+class RevisionStore {
+public:
+    struct Revision {
+        std::uint32_t number;      // 1 for the oldest
+        std::time_t timestamp;     // Of the version itself
+        std::uint32_t size;        // Serialized version bytes
+        std::uint32_t storedBytes; // Delta or keyframe bytes as written to disk
+        bool keyframe;
+    };
+
+    static const std::uint32_t KeyframeInterval = 8;
+
+private:
+    struct Record {
+        std::uint64_t recordId;
+        Revision revision;
+    };
+
+    SegmentStore store;
+    const Compression::Dictionaries& dictionaries;
+    std::unordered_map<std::uint64_t, std::vector<Record>> histories; // Entry id -> revisions, oldest first
+    mutable std::mutex mutex;
+
+public:
+    // Constructors
+    RevisionStore(const std::string& directory, const Compression::Dictionaries& dictionaries);
+
+    // Lifecycle
+    bool open();
+    void close();
+    void startCompactor();
+
+    // History
+    bool append(std::uint64_t entryId, const Entry& version, std::string_view key);
+    std::vector<Revision> list(std::uint64_t entryId) const;
+    bool read(std::uint64_t entryId, std::uint32_t number, std::string_view key, Entry& version) const;
+    bool remove(std::uint64_t entryId);
+
+    // Statistics
+    std::uint64_t getStoredBytes() const;
+    std::uint64_t getVersionBytes() const;
+
+    // Binary deltas: copy ranges of the base and insert literal bytes
+    static SecureString makeDelta(std::string_view base, std::string_view target);
+    static bool applyDelta(std::string_view base, std::string_view delta, SecureString& target);
+
+private:
+    bool readLocked(const std::vector<Record>& history, std::uint32_t number, std::string_view key,
+                    SecureString& version) const;
+};
+
+#endif // REVISION_STORE_HPP
@@ -0,0 +1,109 @@
+#ifndef SECURE_MEMORY_HPP
+#define SECURE_MEMORY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Zeroes memory in a way the compiler may not optimise away
+void secureZero(void* data, size_t length);
+// Zeroes a string's whole buffer, including spare capacity, then empties it
+void scrub(std::string& text);
+
+// Memory for keys and decrypted entry text. Blocks are carved out of
+// page-aligned arenas that are locked into RAM where the system allows it
+// (so they are never swapped out), excluded from core dumps and bracketed by
+// inaccessible guard pages. Each size class owns its arenas, free list and
+// lock, so threads working on different sizes never contend, and allocation
+// after warm-up is a list pop under that class's lock. Freed blocks are
+// zeroed first. Arenas are 1 MB, and the classes run up to 256 KB so entry
+// bodies are pooled too; only requests above that get their own guarded
+// mapping (mmap, mlock and two guard pages per allocation), which takes no
+// lock but costs a few system calls each time.
+class SecurePool {
+public:
+    struct Stats {
+        std::uint64_t mappedBytes;
+        std::uint64_t lockedBytes;
+        std::uint64_t liveBytes;
+    };
+
+    static SecurePool& instance();
+
+    void* allocate(size_t bytes);
+    void deallocate(void* pointer, size_t bytes);
+    // Zeroes and returns to the system every arena with no live blocks left;
+    // called once all decrypted data has been dropped (e.g. on logout)
+    void wipe();
+    Stats getStats();
+
+private:
+    struct Arena {
+        char* mapping;   // Start of the leading guard page
+        char* base;      // First usable byte
+        size_t size;     // Usable bytes
+        size_t used;     // Bump pointer
+        size_t live;     // Blocks currently handed out
+        bool locked;
+    };
+
+    struct SizeClass {
+        std::mutex mutex;
+        std::map<const char*, Arena> arenas; // Keyed by base, to find a block's arena
+        Arena* current = nullptr;            // Arena new blocks are bumped from
+        std::vector<char*> freeList;
+    };
+
+    static const size_t MinClassShift = 5;  // 32 bytes
+    static const size_t ClassCount = 14;    // Up to 256 KB, at least 4 blocks per arena
+    static const size_t ArenaSize = 1024 * 1024;
+
+    std::array<SizeClass, ClassCount> classes;
+    std::atomic<std::uint64_t> liveBytes{0};
+    std::atomic<std::uint64_t> largeBytes{0};
+
+    SecurePool() = default;
+    SecurePool(const SecurePool&) = delete;
+    SecurePool& operator=(const SecurePool&) = delete;
+
+    static size_t classOf(size_t bytes);
+    static Arena* findArena(SizeClass& sizeClass, const char* pointer);
+    static bool addArena(SizeClass& sizeClass);
+};
+
+template <typename T>
+struct SecureAllocator {
+    using value_type = T;
+
+    SecureAllocator() noexcept = default;
+    template <typename U>
+    SecureAllocator(const SecureAllocator<U>&) noexcept {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(SecurePool::instance().allocate(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count) noexcept {
+        SecurePool::instance().deallocate(pointer, count * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const SecureAllocator<T>&, const SecureAllocator<U>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const SecureAllocator<T>&, const SecureAllocator<U>&) noexcept {
+    return false;
+}
+
+// Text up to the small-string size lives inside the string object itself
+// rather than in the pool
+using SecureString = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+
+#endif // SECURE_MEMORY_HPP
@@ -0,0 +1,122 @@
+#ifndef SEGMENT_STORE_HPP
+#define SEGMENT_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <map>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Append-only record store split into fixed-size segment files.
+// Puts and removes append a record to the active segment; superseded records
+// become dead bytes that the background compactor reclaims by rewriting only
+// the sealed segments whose dead/total ratio is over the threshold.
+// One process at a time: open() takes an exclusive lock on the directory.
+class SegmentStore {
+public:
+    struct SegmentStats {
+        std::uint32_t id;
+        std::uint64_t totalBytes;
+        std::uint64_t deadBytes;
+        bool active;
+    };
+
+    using RecordVisitor = std::function<void(std::uint64_t id, std::string_view payload)>;
+
+private:
+    struct Location {
+        std::uint32_t segment;
+        std::uint64_t offset;       // Start of the record header
+        std::uint32_t headerBytes;
+        std::uint32_t length;       // Payload length
+    };
+
+    struct PendingRead {
+        std::uint64_t tag; // Passed to the visitor
+        Location location;
+    };
+
+    struct Segment {
+        std::uint64_t size;
+        std::uint64_t deadBytes;
+    };
+
+    std::string directory;
+    std::map<std::uint64_t, Location> index;
+    std::map<std::uint32_t, Segment> segments;
+    std::uint32_t activeSegment;
+    int activeFd;
+    int lockFd;
+    std::uint64_t nextRecordId;
+    std::uint64_t sequence;
+
+    double compactionThreshold;
+    std::uint64_t ioRateLimit;
+    std::uint64_t maxSegmentSize;
+
+    mutable std::mutex mutex;
+    std::mutex compactionMutex;
+    std::thread compactor;
+    std::condition_variable compactorSignal;
+    bool compactorRunning;
+
+public:
+    // Constructors
+    explicit SegmentStore(const std::string& directory);
+    ~SegmentStore();
+    SegmentStore(const SegmentStore&) = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    // Lifecycle
+    bool open();
+    void close();
+    bool isOpen() const;
+    bool sync();
+
+    // Record access
+    std::uint64_t allocateId();
+    bool put(std::uint64_t id, const std::string& payload);
+    bool remove(std::uint64_t id);
+    bool get(std::uint64_t id, std::string& payload) const;
+    // Reads at most `maxBytes` from the start of a record's payload and sets
+    // `length` to the size of the whole payload
+    bool getPrefix(std::uint64_t id, size_t maxBytes, std::string& head, size_t& length) const;
+    // Visits every live record in file order. A reader thread fills the next
+    // fixed buffer while `visit` runs over the previous one.
+    bool scan(const RecordVisitor& visit) const;
+    // Reads the given records the same way, in file order; `visit` gets
+    // each record's position in `ids` instead of its id
+    bool getMany(const std::vector<std::uint64_t>& ids, const RecordVisitor& visit) const;
+    std::vector<std::uint64_t> getIds() const;
+    size_t getRecordCount() const;
+    std::uint32_t getSegment(std::uint64_t id) const; // 0 if the record does not exist
+    std::uint64_t getGeneration() const;
+
+    // Compaction
+    void setCompactionThreshold(double deadRatio);
+    void setIoRateLimit(std::uint64_t bytesPerSecond);
+    void setMaxSegmentSize(std::uint64_t bytes);
+    void startCompactor();
+    void stopCompactor();
+    bool compactSegment(std::uint32_t segment);
+    std::vector<SegmentStats> getSegmentStats() const;
+
+private:
+    std::string segmentPath(std::uint32_t segment) const;
+    bool replaySegment(std::uint32_t segment, bool last);
+    bool openSegment(std::uint32_t segment);
+    bool openSegmentsLocked(const std::vector<PendingRead>& records, std::map<std::uint32_t, int>& fds) const;
+    bool readRecords(std::vector<PendingRead>& records, std::map<std::uint32_t, int>& fds,
+                     const RecordVisitor& visit) const;
+    void unlock();
+    bool appendRecord(char op, std::uint64_t id, const std::string& payload, Location& location);
+    void markDead(const Location& location);
+    void compactorLoop();
+    void throttle(std::uint64_t bytesDone, std::uint64_t startNanos) const;
+};
+
+#endif // SEGMENT_STORE_HPP
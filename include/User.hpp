@@ -1,6 +1,7 @@
 #ifndef USER_HPP
 #define USER_HPP
 
+#include "SecureMemory.hpp"
 #include <string>
 #include <vector>
 
@@ -9,7 +10,8 @@ private:
     std::string username;
     std::string passwordHash;
     std::string salt;
-    std::string encryptionKey;
+    std::string wrappedKey; // Data key encrypted under a password-derived key
+    SecureString encryptionKey;
     bool isLoggedIn;
 
 public:
@@ -25,7 +27,7 @@ public:
 
     // Getters
     std::string getUsername() const;
-    std::string getEncryptionKey() const;
+    const SecureString& getEncryptionKey() const; // Never copied out of secure memory
 
     // Password management
     static std::string hashPassword(const std::string& password, const std::string& salt);
@@ -36,7 +38,9 @@ public:
     static User deserialize(const std::string& data);
 
 private:
-    void generateEncryptionKey();
+    void deriveKey(const std::string& password, const char* purpose, SecureString& key) const;
+    bool unwrapKey(const std::string& password, SecureString& key) const;
+    void wrapKey(const std::string& password, const SecureString& key);
     bool verifyPassword(const std::string& password) const;
 };
 
@@ -0,0 +1,178 @@
+#include "../include/BloomFilter.hpp"
+#include "../include/Encryption.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[] = "DIARYBLM";
+const std::uint32_t kVersion = 2;
+const int kBitsPerTrigram = 4; // Each taken from 9 bits of the hash: a position in the 512-bit block
+const int kBlockShift = 36;    // Hash bits above those pick the block
+
+std::uint64_t mix(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Identifies the seed in the file header without revealing it
+std::string seedFingerprint(std::uint64_t seed) {
+    return Encryption::hashString("bloom-seed:" + std::to_string(seed)).substr(0, 16);
+}
+
+} // namespace
+
+BloomFilter::BloomFilter(std::uint64_t seed, size_t blocks) : words(blocks * BlockWords, 0), seed(seed) {}
+
+void BloomFilter::addText(std::string_view text) {
+    size_t blocks = words.size() / BlockWords;
+    if (blocks == 0) {
+        return;
+    }
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        std::uint64_t hash = hashTrigram(text.data() + i);
+        std::uint64_t* block = &words[(hash >> kBlockShift) % blocks * BlockWords];
+        for (int k = 0; k < kBitsPerTrigram; ++k) {
+            unsigned bit = static_cast<unsigned>(hash >> (9 * k)) & 511;
+            block[bit >> 6] |= 1ull << (bit & 63);
+        }
+    }
+}
+
+bool BloomFilter::mayContain(std::string_view keyword) const {
+    size_t blocks = words.size() / BlockWords;
+    if (blocks == 0) {
+        return true;
+    }
+    for (size_t i = 0; i + 3 <= keyword.size(); ++i) {
+        std::uint64_t hash = hashTrigram(keyword.data() + i);
+        const std::uint64_t* block = &words[(hash >> kBlockShift) % blocks * BlockWords];
+        for (int k = 0; k < kBitsPerTrigram; ++k) {
+            unsigned bit = static_cast<unsigned>(hash >> (9 * k)) & 511;
+            if ((block[bit >> 6] & (1ull << (bit & 63))) == 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void BloomFilter::merge(const BloomFilter& other) {
+    size_t count = std::min(words.size(), other.words.size());
+    for (size_t i = 0; i < count; ++i) {
+        words[i] |= other.words[i];
+    }
+}
+
+std::uint64_t BloomFilter::seedFromKey(std::string_view key) {
+    SecureString salted(key.data(), key.size());
+    salted += ":bloom";
+    std::string digest = Encryption::hashString(salted);
+    std::uint64_t seed = 0;
+    std::from_chars(digest.data(), digest.data() + std::min<size_t>(16, digest.size()), seed, 16);
+    return seed;
+}
+
+bool BloomFilter::save(const std::string& path, std::string_view key, std::uint64_t generation,
+                       const SegmentFilters& filters) {
+    // Filter words are written in host byte order; the file never leaves this machine
+    std::uint64_t seed = seedFromKey(key);
+    std::string body;
+    for (const auto& filter : filters) {
+        const std::vector<std::uint64_t>& words = filter.second.words;
+        body += std::to_string(filter.first) + " " + std::to_string(words.size()) + "\n";
+        body.append(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(std::uint64_t));
+    }
+
+    std::ostringstream header;
+    header << kMagic << " " << kVersion << " " << generation << " " << seedFingerprint(seed) << " "
+           << filters.size() << " " << Encryption::crc32(body.data(), body.size()) << "\n";
+
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << header.str() << Encryption::encrypt(body, key);
+        if (!file) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+bool BloomFilter::load(const std::string& path, std::string_view key, std::uint64_t generation,
+                       SegmentFilters& filters) {
+    std::uint64_t seed = seedFromKey(key);
+    std::ifstream file(path, std::ios::binary);
+    std::string headerLine;
+    if (!file || !std::getline(file, headerLine)) {
+        return false;
+    }
+
+    std::istringstream header(headerLine);
+    std::string magic;
+    std::uint32_t version = 0;
+    std::uint64_t fileGeneration = 0;
+    std::string fingerprint;
+    size_t count = 0;
+    std::uint32_t crc = 0;
+    if (!(header >> magic >> version >> fileGeneration >> fingerprint >> count >> crc) ||
+        magic != kMagic || version != kVersion || fileGeneration != generation ||
+        fingerprint != seedFingerprint(seed)) {
+        return false;
+    }
+
+    // The checksum covers the plaintext, so it also catches a wrong key
+    std::stringstream encrypted;
+    encrypted << file.rdbuf();
+    SecureString body = Encryption::decrypt(encrypted.str(), key);
+    if (Encryption::crc32(body.data(), body.size()) != crc) {
+        return false;
+    }
+
+    SegmentFilters loaded;
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t newline = body.find('\n', offset);
+        if (newline == std::string::npos) {
+            return false;
+        }
+        std::istringstream line(std::string(body.data() + offset, newline - offset));
+        std::uint32_t segment = 0;
+        size_t wordCount = 0;
+        if (!(line >> segment >> wordCount) || wordCount % BlockWords != 0 ||
+            wordCount > (body.size() - newline - 1) / sizeof(std::uint64_t)) {
+            return false;
+        }
+        BloomFilter filter(seed, wordCount / BlockWords);
+        if (wordCount > 0) {
+            std::memcpy(filter.words.data(), body.data() + newline + 1, wordCount * sizeof(std::uint64_t));
+        }
+        loaded.emplace(segment, std::move(filter));
+        offset = newline + 1 + wordCount * sizeof(std::uint64_t);
+    }
+    if (offset != body.size()) {
+        return false;
+    }
+
+    filters.swap(loaded);
+    return true;
+}
+
+std::uint64_t BloomFilter::hashTrigram(const char* text) const {
+    std::uint64_t trigram = static_cast<unsigned char>(text[0]) |
+                            static_cast<std::uint64_t>(static_cast<unsigned char>(text[1])) << 8 |
+                            static_cast<std::uint64_t>(static_cast<unsigned char>(text[2])) << 16;
+    return mix(trigram ^ seed);
+}
@@ -0,0 +1,127 @@
+#include "../include/BodyCache.hpp"
+
+BodyCache::BodyCache(size_t budgetBytes) : budget(budgetBytes), hits(0), misses(0), evictions(0) {}
+
+void BodyCache::setBudget(size_t budgetBytes, std::vector<std::uint64_t>& evicted) {
+    budget = budgetBytes;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        evict(shard, 0, evicted); // Record ids start at 1, so nothing is kept
+    }
+}
+
+bool BodyCache::touch(std::uint64_t id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.positions.find(id);
+    if (it == shard.positions.end()) {
+        ++misses;
+        return false;
+    }
+    shard.ring[it->second].referenced = true;
+    ++hits;
+    return true;
+}
+
+bool BodyCache::contains(std::uint64_t id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.positions.count(id) > 0;
+}
+
+bool BodyCache::admit(std::uint64_t id, size_t bytes) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.positions.count(id) > 0 || shard.bytes + bytes > shardBudget()) {
+        return false;
+    }
+    // Not marked referenced: bulk-loaded bodies go first if nothing uses them
+    shard.positions[id] = shard.ring.size();
+    shard.ring.push_back({id, bytes, false});
+    shard.bytes += bytes;
+    return true;
+}
+
+void BodyCache::insert(std::uint64_t id, size_t bytes, std::vector<std::uint64_t>& evicted) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.positions.find(id);
+    if (it != shard.positions.end()) {
+        Slot& slot = shard.ring[it->second];
+        shard.bytes = shard.bytes - slot.bytes + bytes;
+        slot.bytes = bytes;
+        slot.referenced = true;
+    } else {
+        shard.positions[id] = shard.ring.size();
+        shard.ring.push_back({id, bytes, true});
+        shard.bytes += bytes;
+    }
+    evict(shard, id, evicted);
+}
+
+void BodyCache::erase(std::uint64_t id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.positions.find(id);
+    if (it != shard.positions.end()) {
+        removeAt(shard, it->second);
+    }
+}
+
+void BodyCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.ring.clear();
+        shard.positions.clear();
+        shard.hand = 0;
+        shard.bytes = 0;
+    }
+}
+
+BodyCache::Stats BodyCache::getStats() {
+    std::uint64_t resident = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        resident += shard.bytes;
+    }
+    return {hits.load(), misses.load(), evictions.load(), resident, budget.load()};
+}
+
+BodyCache::Shard& BodyCache::shardFor(std::uint64_t id) {
+    // Ids are allocated sequentially, so the low bits spread them evenly
+    return shards[id % ShardCount];
+}
+
+size_t BodyCache::shardBudget() const {
+    return budget.load() / ShardCount;
+}
+
+void BodyCache::evict(Shard& shard, std::uint64_t keep, std::vector<std::uint64_t>& evicted) {
+    // CLOCK: sweep the ring, giving recently used bodies a second chance
+    size_t limit = shardBudget();
+    while (shard.bytes > limit && !shard.ring.empty()) {
+        if (shard.ring.size() == 1 && shard.ring[0].id == keep) {
+            break;
+        }
+        shard.hand %= shard.ring.size();
+        Slot& slot = shard.ring[shard.hand];
+        if (slot.id == keep || slot.referenced) {
+            slot.referenced = slot.id == keep && slot.referenced;
+            ++shard.hand;
+            continue;
+        }
+        evicted.push_back(slot.id);
+        removeAt(shard, shard.hand);
+        ++evictions;
+    }
+}
+
+void BodyCache::removeAt(Shard& shard, size_t position) {
+    shard.bytes -= shard.ring[position].bytes;
+    shard.positions.erase(shard.ring[position].id);
+    if (position + 1 != shard.ring.size()) {
+        shard.ring[position] = shard.ring.back();
+        shard.positions[shard.ring[position].id] = position;
+    }
+    shard.ring.pop_back();
+}
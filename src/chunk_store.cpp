@@ -0,0 +1,301 @@
+#include "../include/ChunkStore.hpp"
+#include "../include/Compression.hpp"
+#include "../include/Encryption.hpp"
+#include <array>
+#include <sstream>
+
+namespace {
+
+// Boundaries fall where the rolling hash has its low bits clear; the mask
+// gives ~512 byte chunks, small enough to isolate shared template lines
+const size_t kMinChunkSize = 128;
+const size_t kMaxChunkSize = 4096;
+const std::uint64_t kBoundaryMask = (1u << 9) - 1;
+
+// Bound on a chunk header: a 64 digit hash, two integers of at most 20
+// characters, their separators and the newline
+const size_t kMaxHeaderBytes = 128;
+
+// Gear table: one pseudo-random 64-bit value per byte, fixed so chunk
+// boundaries are stable across runs
+const std::array<std::uint64_t, 256>& gearTable() {
+    static const std::array<std::uint64_t, 256> table = [] {
+        std::array<std::uint64_t, 256> t{};
+        std::uint64_t state = 0x9E3779B97F4A7C15ull;
+        for (auto& value : t) {
+            state += 0x9E3779B97F4A7C15ull;
+            std::uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            value = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Chunk record payload: "<hash> <size> <codec>\n<encrypted body>"
+bool parseChunkHeader(std::string_view payload, std::string& hash, std::uint32_t& size,
+                      int& codec, size_t& bodyOffset) {
+    size_t newline = payload.find('\n');
+    if (newline == std::string_view::npos) {
+        return false;
+    }
+    std::istringstream header(std::string(payload.substr(0, newline)));
+    if (!(header >> hash >> size >> codec)) {
+        return false;
+    }
+    bodyOffset = newline + 1;
+    return true;
+}
+
+} // namespace
+
+ChunkStore::ChunkStore(const std::string& directory, const Compression::Dictionaries& dictionaries)
+    : store(directory), dictionaries(dictionaries) {}
+
+bool ChunkStore::open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!store.open()) {
+        return false;
+    }
+
+    // Only the headers are read here; bodies are fetched by assemble()
+    chunks.clear();
+    manifests.clear();
+    unreferenced.clear();
+    std::string head;
+    for (std::uint64_t id : store.getIds()) {
+        std::string hash;
+        std::uint32_t size = 0;
+        int codec = 0;
+        size_t bodyOffset = 0;
+        size_t length = 0;
+        if (!store.getPrefix(id, kMaxHeaderBytes, head, length) ||
+            !parseChunkHeader(head, hash, size, codec, bodyOffset) ||
+            !chunks.emplace(hash, Chunk{id, size, 0}).second) {
+            store.remove(id); // Unreadable or duplicate left by an interrupted write
+            continue;
+        }
+        unreferenced.insert(hash); // Until an entry's list adopts it
+    }
+    return true;
+}
+
+void ChunkStore::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    store.close();
+    chunks.clear();
+    manifests.clear();
+    unreferenced.clear();
+}
+
+void ChunkStore::startCompactor() {
+    store.startCompactor();
+}
+
+bool ChunkStore::assign(std::string_view content, std::string_view key, std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    hashes.clear();
+
+    // Write any new chunks first; references are only taken once all exist
+    SecureString keyed;
+    for (std::string_view chunk : split(content)) {
+        keyed.assign(key.data(), key.size());
+        keyed.append(chunk.data(), chunk.size());
+        std::string hash = Encryption::hashString(keyed);
+        if (chunks.count(hash) == 0) {
+            SecureString compressed;
+            Compression::Codec codec = Compression::compress(chunk, Compression::getDefaultCodec(), compressed, &dictionaries);
+            std::string payload = hash + " " + std::to_string(chunk.size()) + " " +
+                                  std::to_string(static_cast<int>(codec)) + "\n" +
+                                  Encryption::encrypt(codec == Compression::None ? chunk : std::string_view(compressed), key);
+
+            std::uint64_t recordId = store.allocateId();
+            if (!store.put(recordId, payload)) {
+                return false;
+            }
+            // Collectable until the references below are taken
+            chunks.emplace(hash, Chunk{recordId, static_cast<std::uint32_t>(chunk.size()), 0});
+            unreferenced.insert(hash);
+        }
+        hashes.push_back(hash);
+    }
+    if (!store.sync()) {
+        return false;
+    }
+
+    for (const auto& hash : hashes) {
+        ++chunks[hash].refCount;
+    }
+    return true;
+}
+
+void ChunkStore::commit(std::uint64_t entryId, const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseLocked(entryId);
+    if (!hashes.empty()) {
+        manifests[entryId] = hashes;
+    }
+}
+
+void ChunkStore::abandon(const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& hash : hashes) {
+        unreferenceLocked(hash);
+    }
+}
+
+void ChunkStore::retain(std::uint64_t entryId, const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string>& manifest = manifests[entryId];
+    manifest.insert(manifest.end(), hashes.begin(), hashes.end());
+}
+
+void ChunkStore::adopt(std::uint64_t entryId, const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseLocked(entryId);
+    for (const auto& hash : hashes) {
+        auto it = chunks.find(hash);
+        if (it != chunks.end()) {
+            ++it->second.refCount;
+        }
+    }
+    manifests[entryId] = hashes;
+}
+
+void ChunkStore::release(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseLocked(entryId);
+}
+
+bool ChunkStore::assemble(const std::vector<std::string>& hashes, std::string_view key,
+                          SecureString& content) const {
+    content.clear();
+    std::vector<std::uint64_t> recordIds;
+    recordIds.reserve(hashes.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& hash : hashes) {
+            auto it = chunks.find(hash);
+            if (it == chunks.end()) {
+                return false;
+            }
+            recordIds.push_back(it->second.recordId);
+        }
+    }
+
+    // Read in file order with as few preads as possible, the next batch
+    // arriving while this one is decrypted; each chunk lands in its slot
+    std::vector<SecureString> pieces(hashes.size());
+    bool valid = true;
+    bool read = store.getMany(recordIds, [&](std::uint64_t position, std::string_view payload) {
+        std::string storedHash;
+        std::uint32_t size = 0;
+        int codec = 0;
+        size_t bodyOffset = 0;
+        if (!valid || !parseChunkHeader(payload, storedHash, size, codec, bodyOffset) ||
+            storedHash != hashes[position] ||
+            !Compression::decompress(Encryption::decrypt(payload.substr(bodyOffset), key),
+                                     static_cast<Compression::Codec>(codec), pieces[position], &dictionaries) ||
+            pieces[position].size() != size) {
+            valid = false;
+        }
+    });
+    if (!read || !valid) {
+        return false;
+    }
+
+    size_t total = 0;
+    for (const auto& piece : pieces) {
+        total += piece.size();
+    }
+    content.reserve(total);
+    for (const auto& piece : pieces) {
+        content += piece;
+    }
+    return true;
+}
+
+bool ChunkStore::collectGarbage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Only chunks that dropped to 0 are looked at; some were referenced again since
+    bool removed = false;
+    for (const auto& hash : unreferenced) {
+        auto it = chunks.find(hash);
+        if (it != chunks.end() && it->second.refCount == 0) {
+            store.remove(it->second.recordId);
+            chunks.erase(it);
+            removed = true;
+        }
+    }
+    unreferenced.clear();
+    return !removed || store.sync();
+}
+
+std::uint64_t ChunkStore::getUniqueBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint64_t total = 0;
+    for (const auto& chunk : chunks) {
+        if (chunk.second.refCount > 0) {
+            total += chunk.second.size;
+        }
+    }
+    return total;
+}
+
+std::uint64_t ChunkStore::getReferencedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint64_t total = 0;
+    for (const auto& manifest : manifests) {
+        for (const auto& hash : manifest.second) {
+            auto it = chunks.find(hash);
+            if (it != chunks.end()) {
+                total += it->second.size;
+            }
+        }
+    }
+    return total;
+}
+
+std::vector<std::string_view> ChunkStore::split(std::string_view content) {
+    const auto& gear = gearTable();
+    std::vector<std::string_view> pieces;
+    size_t start = 0;
+    std::uint64_t hash = 0;
+
+    for (size_t i = 0; i < content.size(); ++i) {
+        hash = (hash << 1) + gear[static_cast<unsigned char>(content[i])];
+        size_t length = i + 1 - start;
+        if ((length >= kMinChunkSize && (hash & kBoundaryMask) == 0) || length >= kMaxChunkSize) {
+            pieces.push_back(content.substr(start, length));
+            start = i + 1;
+            hash = 0;
+        }
+    }
+    if (start < content.size()) {
+        pieces.push_back(content.substr(start));
+    }
+    return pieces;
+}
+
+void ChunkStore::releaseLocked(std::uint64_t entryId) {
+    auto manifest = manifests.find(entryId);
+    if (manifest == manifests.end()) {
+        return;
+    }
+    for (const auto& hash : manifest->second) {
+        unreferenceLocked(hash);
+    }
+    manifests.erase(manifest);
+}
+
+void ChunkStore::unreferenceLocked(const std::string& hash) {
+    auto it = chunks.find(hash);
+    if (it != chunks.end() && it->second.refCount > 0 && --it->second.refCount == 0) {
+        unreferenced.insert(hash);
+    }
+}
@@ -0,0 +1,453 @@
+#include "../include/Compression.hpp"
+#include "../include/Encryption.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef DIARY_HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#ifdef DIARY_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace {
+
+const size_t kWindowSize = 65535;
+const size_t kMinMatch = 4;
+const int kHashBits = 14;
+
+Compression::Codec bestAvailableCodec() {
+#if defined(DIARY_HAVE_ZSTD)
+    return Compression::Zstd;
+#elif defined(DIARY_HAVE_LZ4)
+    return Compression::Lz4;
+#else
+    return Compression::Builtin;
+#endif
+}
+
+std::atomic<std::uint8_t> defaultCodec(bestAvailableCodec());
+
+// Frame header: varint raw length, varint dictionary id
+void writeVarint(SecureString& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool readVarint(std::string_view in, size_t& pos, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(in[pos++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint32_t read32(const char* p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+std::uint32_t hash32(std::uint32_t value) {
+    return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+void writeLength(SecureString& out, size_t length) {
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+bool readLength(const char*& p, const char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (p >= end) {
+            return false;
+        }
+        byte = static_cast<unsigned char>(*p++);
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+void emitSequence(SecureString& out, const char* literals, size_t literalLength,
+                  size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+    char token = static_cast<char>((std::min<size_t>(literalLength, 15) << 4) |
+                                   std::min<size_t>(matchCode, 15));
+    out += token;
+    if (literalLength >= 15) {
+        writeLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+    if (matchLength) {
+        out += static_cast<char>(offset & 0xFF);
+        out += static_cast<char>(offset >> 8);
+        if (matchCode >= 15) {
+            writeLength(out, matchCode - 15);
+        }
+    }
+}
+
+} // namespace
+
+bool Compression::isAvailable(Codec codec) {
+    switch (codec) {
+        case None:
+        case Builtin:
+            return true;
+#ifdef DIARY_HAVE_ZSTD
+        case Zstd:
+            return true;
+#endif
+#ifdef DIARY_HAVE_LZ4
+        case Lz4:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+Compression::Codec Compression::getDefaultCodec() {
+    return static_cast<Codec>(defaultCodec.load());
+}
+
+void Compression::setDefaultCodec(Codec codec) {
+    defaultCodec = isAvailable(codec) ? codec : Builtin;
+}
+
+Compression::Codec Compression::compress(std::string_view data, Codec codec, SecureString& compressed,
+                                         const Dictionaries* dictionaries) {
+    if (codec == None || !isAvailable(codec) || data.empty()) {
+        return None;
+    }
+
+    std::uint32_t dictionaryId = dictionaries ? dictionaries->getActive() : 0;
+    std::string_view dictionary;
+    if (dictionaryId != 0 && !dictionaries->find(dictionaryId, dictionary)) {
+        dictionaryId = 0;
+    }
+
+    compressed.clear();
+    writeVarint(compressed, data.size());
+    writeVarint(compressed, dictionaryId);
+    [[maybe_unused]] size_t headerSize = compressed.size();
+
+    switch (codec) {
+#ifdef DIARY_HAVE_ZSTD
+        case Zstd: {
+            size_t bound = ZSTD_compressBound(data.size());
+            compressed.resize(headerSize + bound);
+            ZSTD_CCtx* context = ZSTD_createCCtx();
+            size_t size = ZSTD_compress_usingDict(context, &compressed[headerSize], bound,
+                                                  data.data(), data.size(),
+                                                  dictionary.data(), dictionary.size(), 3);
+            ZSTD_freeCCtx(context);
+            if (ZSTD_isError(size)) {
+                return None;
+            }
+            compressed.resize(headerSize + size);
+            break;
+        }
+#endif
+#ifdef DIARY_HAVE_LZ4
+        case Lz4: {
+            int bound = LZ4_compressBound(static_cast<int>(data.size()));
+            compressed.resize(headerSize + bound);
+            LZ4_stream_t* stream = LZ4_createStream();
+            LZ4_loadDict(stream, dictionary.data(), static_cast<int>(dictionary.size()));
+            int size = LZ4_compress_fast_continue(stream, data.data(), &compressed[headerSize],
+                                                  static_cast<int>(data.size()), bound, 1);
+            LZ4_freeStream(stream);
+            if (size <= 0) {
+                return None;
+            }
+            compressed.resize(headerSize + size);
+            break;
+        }
+#endif
+        default:
+            compressed += builtinCompress(data, dictionary);
+            break;
+    }
+
+    // Short entries often grow; store those verbatim
+    return compressed.size() < data.size() ? codec : None;
+}
+
+bool Compression::decompress(std::string_view compressed, Codec codec, SecureString& data,
+                             const Dictionaries* dictionaries) {
+    if (codec == None) {
+        data.assign(compressed.data(), compressed.size());
+        return true;
+    }
+
+    size_t pos = 0;
+    std::uint64_t rawLength = 0;
+    std::uint64_t dictionaryId = 0;
+    if (!isAvailable(codec) || !readVarint(compressed, pos, rawLength) ||
+        !readVarint(compressed, pos, dictionaryId)) {
+        return false;
+    }
+
+    std::string_view dictionary;
+    if (dictionaryId != 0 &&
+        (!dictionaries || !dictionaries->find(static_cast<std::uint32_t>(dictionaryId), dictionary))) {
+        return false;
+    }
+
+    const char* payload = compressed.data() + pos;
+    size_t payloadLength = compressed.size() - pos;
+    if (rawLength > payloadLength * 256 + 64) {
+        return false; // Corrupt header; no codec expands this much
+    }
+
+    switch (codec) {
+#ifdef DIARY_HAVE_ZSTD
+        case Zstd: {
+            SecureString out(rawLength, '\0');
+            ZSTD_DCtx* context = ZSTD_createDCtx();
+            size_t size = ZSTD_decompress_usingDict(context, &out[0], out.size(), payload, payloadLength,
+                                                    dictionary.data(), dictionary.size());
+            ZSTD_freeDCtx(context);
+            if (ZSTD_isError(size) || size != rawLength) {
+                return false;
+            }
+            data.swap(out);
+            return true;
+        }
+#endif
+#ifdef DIARY_HAVE_LZ4
+        case Lz4: {
+            SecureString out(rawLength, '\0');
+            int size = LZ4_decompress_safe_usingDict(payload, &out[0], static_cast<int>(payloadLength),
+                                                     static_cast<int>(rawLength), dictionary.data(),
+                                                     static_cast<int>(dictionary.size()));
+            if (size < 0 || static_cast<std::uint64_t>(size) != rawLength) {
+                return false;
+            }
+            data.swap(out);
+            return true;
+        }
+#endif
+        default:
+            return builtinDecompress(payload, payloadLength, dictionary, rawLength, data);
+    }
+}
+
+SecureString Compression::trainDictionary(const std::vector<std::string_view>& samples, size_t maxSize) {
+#ifdef DIARY_HAVE_ZSTD
+    SecureString joined;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples) {
+        joined.append(sample.data(), sample.size());
+        sizes.push_back(sample.size());
+    }
+    SecureString dictionary(maxSize, '\0');
+    size_t size = ZDICT_trainFromBuffer(&dictionary[0], maxSize, joined.data(), sizes.data(),
+                                        static_cast<unsigned>(sizes.size()));
+    if (!ZDICT_isError(size)) {
+        dictionary.resize(size);
+        return dictionary;
+    }
+#endif
+
+    // Diary text repeats whole lines (templates, checklists): keep the lines
+    // shared by the most entries, weighted by the bytes they would save
+    std::unordered_map<std::string_view, size_t> counts;
+    for (const auto& sample : samples) {
+        std::unordered_set<std::string_view> seen;
+        size_t start = 0;
+        while (start < sample.size()) {
+            size_t end = sample.find('\n', start);
+            end = end == std::string_view::npos ? sample.size() : end + 1;
+            std::string_view line(sample.data() + start, end - start);
+            if (line.size() >= 8 && seen.insert(line).second) {
+                ++counts[line];
+            }
+            start = end;
+        }
+    }
+
+    std::vector<std::pair<size_t, std::string_view>> ranked;
+    for (const auto& line : counts) {
+        if (line.second >= 2) {
+            ranked.emplace_back((line.second - 1) * line.first.size(), line.first);
+        }
+    }
+    std::sort(ranked.begin(), ranked.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    size_t limit = std::min(maxSize, kWindowSize);
+    std::vector<std::string_view> chosen;
+    size_t total = 0;
+    for (const auto& line : ranked) {
+        if (total + line.second.size() > limit) {
+            continue;
+        }
+        chosen.push_back(line.second);
+        total += line.second.size();
+    }
+
+    // Most valuable content last, closest to the data being compressed
+    SecureString dictionary;
+    dictionary.reserve(total);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dictionary.append(it->data(), it->size());
+    }
+    return dictionary;
+}
+
+std::uint32_t Compression::Dictionaries::add(std::string_view dictionary) {
+    if (dictionary.empty()) {
+        return 0;
+    }
+    std::uint32_t id = Encryption::crc32(dictionary.data(), dictionary.size());
+    id = id == 0 ? 1 : id;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    dictionaries[id].assign(dictionary.data(), dictionary.size());
+    return id;
+}
+
+bool Compression::Dictionaries::find(std::uint32_t id, std::string_view& dictionary) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = dictionaries.find(id);
+    if (it == dictionaries.end()) {
+        return false;
+    }
+    dictionary = std::string_view(it->second.data(), it->second.size());
+    return true;
+}
+
+void Compression::Dictionaries::setActive(std::uint32_t id) {
+    active = id;
+}
+
+std::uint32_t Compression::Dictionaries::getActive() const {
+    return active.load();
+}
+
+void Compression::Dictionaries::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    dictionaries.clear(); // Releasing the buffers zeroes them
+    active = 0;
+}
+
+// LZ4-style block format: token (literal length | match length), literals,
+// 16-bit match offset. Matches may reach back into the dictionary.
+SecureString Compression::builtinCompress(std::string_view data, std::string_view dictionary) {
+    size_t prefix = std::min(dictionary.size(), kWindowSize);
+    SecureString input;
+    input.reserve(prefix + data.size());
+    input.append(dictionary.data() + dictionary.size() - prefix, prefix);
+    input.append(data.data(), data.size());
+
+    const char* base = input.data();
+    const size_t end = input.size();
+    std::vector<std::int64_t> table(size_t(1) << kHashBits, -1);
+    for (size_t i = 0; i + kMinMatch <= prefix; ++i) {
+        table[hash32(read32(base + i))] = static_cast<std::int64_t>(i);
+    }
+
+    SecureString out;
+    out.reserve(data.size() / 2 + 16);
+    size_t anchor = prefix;
+    size_t i = prefix;
+    while (i + kMinMatch <= end) {
+        std::uint32_t h = hash32(read32(base + i));
+        std::int64_t candidate = table[h];
+        table[h] = static_cast<std::int64_t>(i);
+
+        if (candidate < 0 || i - static_cast<size_t>(candidate) > kWindowSize ||
+            read32(base + candidate) != read32(base + i)) {
+            ++i;
+            continue;
+        }
+
+        size_t length = kMinMatch;
+        while (i + length < end && base[candidate + length] == base[i + length]) {
+            ++length;
+        }
+        emitSequence(out, base + anchor, i - anchor, i - static_cast<size_t>(candidate), length);
+
+        // Index the positions inside the match sparsely to keep it linear
+        for (size_t k = i + 1; k + kMinMatch <= end && k < i + length; k += 3) {
+            table[hash32(read32(base + k))] = static_cast<std::int64_t>(k);
+        }
+        i += length;
+        anchor = i;
+    }
+    emitSequence(out, base + anchor, end - anchor, 0, 0);
+    return out;
+}
+
+bool Compression::builtinDecompress(const char* data, size_t length, std::string_view dictionary,
+                                    size_t rawLength, SecureString& out) {
+    size_t prefix = std::min(dictionary.size(), kWindowSize);
+    SecureString buffer;
+    buffer.reserve(prefix + rawLength);
+    buffer.append(dictionary.data() + dictionary.size() - prefix, prefix);
+
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end) {
+        unsigned char token = static_cast<unsigned char>(*p++);
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(p, end, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(end - p)) {
+            return false;
+        }
+        buffer.append(p, literalLength);
+        p += literalLength;
+        if (p == end) {
+            break;
+        }
+
+        if (end - p < 2) {
+            return false;
+        }
+        size_t offset = static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8);
+        p += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !readLength(p, end, matchLength)) {
+            return false;
+        }
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > buffer.size() || buffer.size() + matchLength > prefix + rawLength) {
+            return false;
+        }
+
+        // Byte-wise copy: the match may overlap the bytes it produces
+        size_t from = buffer.size() - offset;
+        for (size_t k = 0; k < matchLength; ++k) {
+            buffer += buffer[from + k];
+        }
+    }
+
+    if (buffer.size() != prefix + rawLength) {
+        return false;
+    }
+    out.assign(buffer, prefix, rawLength);
+    return true;
+}
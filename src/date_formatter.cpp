@@ -0,0 +1,74 @@
+#include "../include/DateFormatter.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const std::time_t kSecondsPerDay = 24 * 60 * 60;
+
+struct DayCache {
+    std::time_t start = 0;   // Local midnight
+    std::time_t end = 0;     // Next local midnight
+    char prefix[48] = {0};   // "YYYY-MM-DD "
+};
+
+thread_local DayCache dayCache;
+
+void writeTwoDigits(char* out, int value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+size_t writeDateTime(char* out, const char* prefix, int hour, int minute, int second) {
+    std::memcpy(out, prefix, 11);
+    writeTwoDigits(out + 11, hour);
+    out[13] = ':';
+    writeTwoDigits(out + 14, minute);
+    out[16] = ':';
+    writeTwoDigits(out + 17, second);
+    out[19] = '\0';
+    return 19;
+}
+
+} // namespace
+
+size_t DateFormatter::format(std::time_t time, char* buffer, size_t size) {
+    if (size < BufferSize) {
+        return 0;
+    }
+
+    DayCache& cache = dayCache;
+    if (time < cache.start || time >= cache.end) {
+        std::tm tm;
+        if (!toLocalTime(time, tm)) {
+            return 0;
+        }
+        std::snprintf(cache.prefix, sizeof(cache.prefix), "%04d-%02d-%02d ",
+                      tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+
+        // Only cache days with a constant UTC offset, where the time of day
+        // is a plain offset from midnight
+        std::time_t start = time - (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec);
+        std::tm first;
+        std::tm last;
+        if (!toLocalTime(start, first) || !toLocalTime(start + kSecondsPerDay - 1, last) ||
+            first.tm_hour != 0 || first.tm_min != 0 || first.tm_sec != 0 ||
+            last.tm_mday != tm.tm_mday || last.tm_hour != 23 || last.tm_min != 59 || last.tm_sec != 59) {
+            cache.start = cache.end = 0;
+            return writeDateTime(buffer, cache.prefix, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        }
+        cache.start = start;
+        cache.end = start + kSecondsPerDay;
+    }
+
+    int seconds = static_cast<int>(time - cache.start);
+    return writeDateTime(buffer, cache.prefix, seconds / 3600, seconds / 60 % 60, seconds % 60);
+}
+
+bool DateFormatter::toLocalTime(std::time_t time, std::tm& result) {
+#ifdef _WIN32
+    return localtime_s(&result, &time) == 0;
+#else
+    return localtime_r(&time, &result) != nullptr;
+#endif
+}
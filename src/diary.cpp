@@ -1,17 +1,94 @@
 #include "../include/Diary.hpp"
+#include "../include/Compression.hpp"
+#include "../include/Encryption.hpp"
+#include "../include/DateFormatter.hpp"
+#include "../include/BoundedQueue.hpp"
+#include "../include/SecureMemory.hpp"
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <exception>
+#include <iterator>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
+namespace {
+
+const size_t kDictionaryTrainingThreshold = 32;
+const size_t kDictionarySize = 16 * 1024;
+const size_t kDictionarySampleBytes = 1024 * 1024;
+const size_t kMinChunkedContentSize = 256; // Smaller bodies are cheaper stored inline
+const size_t kParallelLoadThreshold = 256;  // Below this, starting workers costs more than it saves
+const size_t kMaxLoadThreads = 16;
+const size_t kLoadQueueCapacity = 1024;
+
+struct LoadRecord {
+    std::uint64_t id;
+    std::string payload;
+};
+
+// Replaces `path` with `data` so that after a crash it holds either the old
+// or the new contents, and the new contents are on disk once this returns
+bool writeFileDurably(const std::string& path, const std::string& data) {
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close(fd);
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    bool synced = ::fsync(fd) == 0;
+    if (::close(fd) != 0 || !synced) {
+        return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        return false;
+    }
+    int directory = ::open(fs::path(path).parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+    if (directory < 0) {
+        return false;
+    }
+    synced = ::fsync(directory) == 0;
+    ::close(directory);
+    return synced;
+}
+
+} // namespace
+
 Diary::Diary() : storageDirectory("./data") {
     fs::create_directories(storageDirectory);
+    store = std::make_unique<SegmentStore>(getSegmentsDirectory());
+    chunkStore = std::make_unique<ChunkStore>(getChunksDirectory(), dictionaries);
+    revisionStore = std::make_unique<RevisionStore>(getRevisionsDirectory(), dictionaries);
 }
 
 Diary::Diary(const std::string& storageDir) : storageDirectory(storageDir) {
     fs::create_directories(storageDirectory);
+    store = std::make_unique<SegmentStore>(getSegmentsDirectory());
+    chunkStore = std::make_unique<ChunkStore>(getChunksDirectory(), dictionaries);
+    revisionStore = std::make_unique<RevisionStore>(getRevisionsDirectory(), dictionaries);
 }
 
 bool Diary::registerUser(const std::string& username, const std::string& password) {
@@ -25,30 +102,51 @@ bool Diary::registerUser(const std::string& username, const std::string& passwor
 }
 
 bool Diary::loginUser(const std::string& username, const std::string& password) {
-    std::string userFile = getUserFilePath();
-    if (!fs::exists(userFile)) {
-        return false; // User doesn't exist
+    // Already loaded and decrypted (e.g. a daemon serving a repeat session):
+    // only the password needs checking
+    if (currentUser && currentUser->isAuthenticated()) {
+        return currentUser->getUsername() == username && currentUser->login(password);
     }
     
-    if (loadFromFile()) {
-        if (currentUser && currentUser->getUsername() == username) {
-            bool success = currentUser->login(password);
-            if (success) {
-                decryptEntries();
-            }
-            return success;
-        }
+    // Check the password before touching the entry store, so a failed
+    // login costs one small file read
+    if (!loadUser() || currentUser->getUsername() != username || !currentUser->login(password)) {
+        return false;
     }
-    return false;
+    
+    loadDictionaries();
+    if (!loadEntries()) {
+        currentUser->logout();
+        return false;
+    }
+    if (dictionaries.getActive() == 0 && entries.size() >= kDictionaryTrainingThreshold) {
+        trainCompressionDictionary();
+    }
+    store->startCompactor();
+    chunkStore->startCompactor();
+    revisionStore->startCompactor();
+    return true;
 }
 
 void Diary::logoutUser() {
     if (currentUser) {
-        encryptEntries();
+        saveToFile(); // Before logging out: the index snapshot needs the key
         currentUser->logout();
-        saveToFile();
     }
+    // Stored records are already encrypted, so the decrypted bodies are just
+    // dropped: each is zeroed as it is released, and the emptied pool arenas
+    // are then wiped and unmapped together
     entries.clear();
+    rebuildIndexes();
+    segmentFilters.clear();
+    entrySegments.clear();
+    segmentEntries.clear();
+    bodyCache.clear();
+    store->close();
+    chunkStore->close();
+    revisionStore->close();
+    dictionaries.clear();
+    SecurePool::instance().wipe();
 }
 
 bool Diary::addEntry(const Entry& entry) {
@@ -57,7 +155,15 @@ bool Diary::addEntry(const Entry& entry) {
     }
     
     entries.push_back(entry);
-    return saveToFile();
+    Entry& added = entries.back();
+    added.setId(store->allocateId());
+    indexEntry(added);
+    idIndex[added.getId()] = entries.size() - 1;
+    if (!persistEntry(added)) {
+        return false;
+    }
+    cacheBody(added);
+    return true;
 }
 
 bool Diary::deleteEntry(const std::string& title) {
@@ -69,8 +175,22 @@ bool Diary::deleteEntry(const std::string& title) {
                           [&title](const Entry& e) { return e.getTitle() == title; });
     
     if (it != entries.end()) {
-        entries.erase(it);
-        return saveToFile();
+        std::uint64_t id = it->getId();
+        unindexEntry(*it);
+        unplaceEntry(id);
+        idIndex.erase(id);
+        bodyCache.erase(id);
+        for (auto next = entries.erase(it); next != entries.end(); ++next) {
+            --idIndex[next->getId()];
+        }
+        if (!store->remove(id) || !store->sync()) {
+            return false;
+        }
+        // The entry is gone once its removal is durable, so its chunks go
+        // too even if the history cannot be dropped
+        chunkStore->release(id);
+        bool historyRemoved = revisionStore->remove(id);
+        return chunkStore->collectGarbage() && historyRemoved;
     }
     return false;
 }
@@ -84,8 +204,21 @@ bool Diary::updateEntry(const std::string& title, const Entry& newEntry) {
                           [&title](const Entry& e) { return e.getTitle() == title; });
     
     if (it != entries.end()) {
+        std::uint64_t id = it->getId();
+        // Keep the version being replaced. A body that cannot be decoded is
+        // left alone: overwriting it would lose it without a revision.
+        if (!ensureResident(*it) || !revisionStore->append(id, *it, currentUser->getEncryptionKey())) {
+            return false;
+        }
+        unindexEntry(*it);
         *it = newEntry;
-        return saveToFile();
+        it->setId(id);
+        indexEntry(*it);
+        if (!persistEntry(*it)) {
+            return false;
+        }
+        cacheBody(*it);
+        return true;
     }
     return false;
 }
@@ -97,15 +230,80 @@ Entry* Diary::getEntry(const std::string& title) {
     
     auto it = std::find_if(entries.begin(), entries.end(),
                           [&title](const Entry& e) { return e.getTitle() == title; });
+    if (it == entries.end()) {
+        return nullptr;
+    }
     
-    return it != entries.end() ? &(*it) : nullptr;
+    ensureResident(*it);
+    return &(*it);
 }
 
 std::vector<Entry> Diary::getAllEntries() const {
     if (!currentUser || !currentUser->isAuthenticated()) {
         return std::vector<Entry>();
     }
-    return entries;
+    
+    std::vector<Entry> all = entries;
+    for (auto& entry : all) {
+        fillBody(entry);
+    }
+    return all;
+}
+
+size_t Diary::getEntryCount() const {
+    if (!currentUser || !currentUser->isAuthenticated()) {
+        return 0;
+    }
+    return entries.size();
+}
+
+bool Diary::nextPage(EntryCursor& cursor, size_t pageSize, std::vector<Entry>& page) const {
+    if (!currentUser || !currentUser->isAuthenticated()) {
+        page.clear();
+        return false;
+    }
+    
+    // Resume strictly after the last entry handed out, so edits between
+    // pages neither repeat nor skip entries
+    auto it = cursor.started ? timeIndex.upper_bound({cursor.timestamp, cursor.id}) : timeIndex.begin();
+    size_t count = 0;
+    for (; it != timeIndex.end() && count < pageSize; ++it, ++count) {
+        const Entry& entry = entries[idIndex.at(it->second)];
+        if (count < page.size()) {
+            page[count] = entry; // Reuses the buffers of the previous page
+        } else {
+            page.push_back(entry);
+        }
+        fillBody(page[count]);
+        cursor.timestamp = it->first;
+        cursor.id = it->second;
+        cursor.started = true;
+    }
+    page.resize(count);
+    return count > 0;
+}
+
+std::vector<RevisionStore::Revision> Diary::listRevisions(const std::string& title) const {
+    if (!currentUser || !currentUser->isAuthenticated()) {
+        return std::vector<RevisionStore::Revision>();
+    }
+    
+    auto it = std::find_if(entries.begin(), entries.end(),
+                          [&title](const Entry& e) { return e.getTitle() == title; });
+    if (it == entries.end()) {
+        return std::vector<RevisionStore::Revision>();
+    }
+    return revisionStore->list(it->getId());
+}
+
+bool Diary::getRevision(const std::string& title, std::uint32_t number, Entry& revision) const {
+    if (!currentUser || !currentUser->isAuthenticated()) {
+        return false;
+    }
+    
+    auto it = std::find_if(entries.begin(), entries.end(),
+                          [&title](const Entry& e) { return e.getTitle() == title; });
+    return it != entries.end() && revisionStore->read(it->getId(), number, currentUser->getEncryptionKey(), revision);
 }
 
 std::vector<Entry> Diary::searchByDate(const std::time_t& date) {
@@ -113,16 +311,23 @@ std::vector<Entry> Diary::searchByDate(const std::time_t& date) {
         return std::vector<Entry>();
     }
     
+    // Every entry stamped between local midnight and the next one
     std::vector<Entry> results;
-    std::tm search_tm = *std::localtime(&date);
+    std::tm day;
+    if (!DateFormatter::toLocalTime(date, day)) {
+        return results;
+    }
+    day.tm_hour = day.tm_min = day.tm_sec = 0;
+    day.tm_isdst = -1;
+    std::time_t start = std::mktime(&day);
+    day.tm_mday += 1;
+    day.tm_hour = day.tm_min = day.tm_sec = 0;
+    day.tm_isdst = -1;
+    std::time_t end = std::mktime(&day);
     
-    for (const auto& entry : entries) {
-        std::tm entry_tm = *std::localtime(&entry.getTimestamp());
-        if (entry_tm.tm_year == search_tm.tm_year &&
-            entry_tm.tm_mon == search_tm.tm_mon &&
-            entry_tm.tm_mday == search_tm.tm_mday) {
-            results.push_back(entry);
-        }
+    for (auto it = timeIndex.lower_bound({start, 0}); it != timeIndex.end() && it->first < end; ++it) {
+        results.push_back(entries[idIndex.at(it->second)]);
+        fillBody(results.back());
     }
     
     return results;
@@ -133,11 +338,33 @@ std::vector<Entry> Diary::searchByKeyword(const std::string& keyword) {
         return std::vector<Entry>();
     }
     
+    // Segments whose filter rules the keyword out are passed over without
+    // looking at their entries; segments with no filter are always searched
+    std::vector<size_t> positions;
+    for (const auto& segment : segmentEntries) {
+        auto filter = segmentFilters.find(segment.first);
+        if (filter != segmentFilters.end() && !filter->second.mayContain(keyword)) {
+            continue;
+        }
+        for (std::uint64_t id : segment.second) {
+            auto position = idIndex.find(id);
+            if (position != idIndex.end()) {
+                positions.push_back(position->second);
+            }
+        }
+    }
+    std::sort(positions.begin(), positions.end()); // Results stay in entry order
+    
+    // Bodies that are not resident are read back only for this search,
+    // so a scan does not push the working set out of the cache
     std::vector<Entry> results;
-    for (const auto& entry : entries) {
-        if (entry.getTitle().find(keyword) != std::string::npos ||
-            entry.getContent().find(keyword) != std::string::npos) {
-            results.push_back(entry);
+    Entry candidate;
+    for (size_t position : positions) {
+        candidate = entries[position];
+        fillBody(candidate);
+        if (candidate.getTitle().find(keyword) != std::string::npos ||
+            candidate.getContent().find(keyword) != std::string::npos) {
+            results.push_back(candidate);
         }
     }
     
@@ -149,12 +376,21 @@ std::vector<Entry> Diary::searchByTag(const std::string& tag) {
         return std::vector<Entry>();
     }
     
-    std::vector<Entry> results;
-    for (const auto& entry : entries) {
-        if (entry.getTags().find(tag) != std::string::npos) {
-            results.push_back(entry);
+    // Match against each distinct tag string once, then list in id order
+    std::vector<std::uint64_t> ids;
+    for (const auto& tags : tagIndex) {
+        if (tags.first.find(tag) != std::string::npos) {
+            ids.insert(ids.end(), tags.second.begin(), tags.second.end());
         }
     }
+    std::sort(ids.begin(), ids.end());
+    
+    std::vector<Entry> results;
+    results.reserve(ids.size());
+    for (std::uint64_t id : ids) {
+        results.push_back(entries[idIndex.at(id)]);
+        fillBody(results.back());
+    }
     
     return results;
 }
@@ -172,87 +408,600 @@ bool Diary::saveToFile() const {
     userFile << currentUser->serialize();
     userFile.close();
     
-    // Save entries
-    std::ofstream entriesFile(getEntriesFilePath());
-    if (!entriesFile) {
+    // Search indexes are derived from entry text, so they are stored
+    // encrypted and only while someone is logged in
+    if (currentUser->isAuthenticated() && store->isOpen()) {
+        const SecureString& key = currentUser->getEncryptionKey();
+        std::uint64_t generation = store->getGeneration();
+        if (!IndexSnapshot::save(getIndexSnapshotPath(), key, generation, timeIndex, tagIndex) ||
+            !BloomFilter::save(getSegmentFiltersPath(), key, generation, segmentFilters)) {
+            return false;
+        }
+    }
+    
+    // Entries are written incrementally by persistEntry; just make them durable
+    return store->sync();
+}
+
+bool Diary::loadFromFile() {
+    return loadUser() && loadEntries();
+}
+
+bool Diary::trainCompressionDictionary() {
+    if (!currentUser || !currentUser->isAuthenticated()) {
         return false;
     }
     
-    entriesFile << entries.size() << "\n";
-    for (const auto& entry : entries) {
-        entriesFile << entry.serialize() << "\n---END_ENTRY---\n";
+    // Sample the newest entries; they best predict what is written next
+    std::vector<std::string_view> samples;
+    size_t sampleBytes = 0;
+    for (auto it = entries.rbegin(); it != entries.rend() && sampleBytes < kDictionarySampleBytes; ++it) {
+        if (!it->isEncrypted() && !it->getContent().empty()) {
+            samples.push_back(it->getContent());
+            sampleBytes += samples.back().size();
+        }
     }
     
+    SecureString dictionary = Compression::trainDictionary(samples, kDictionarySize);
+    std::uint32_t id = dictionaries.add(dictionary);
+    if (id == 0) {
+        return false;
+    }
+    
+    // Dictionaries are built from entry text, so they are stored encrypted.
+    // The dictionary must be durable before `active` names it: entries
+    // compressed with it cannot be read without it.
+    std::error_code ec;
+    fs::create_directories(getDictionaryDirectory(), ec);
+    if (!writeFileDurably(getDictionaryDirectory() + "/" + std::to_string(id) + ".dict",
+                          Encryption::encrypt(dictionary, currentUser->getEncryptionKey())) ||
+        !writeFileDurably(getDictionaryDirectory() + "/active", std::to_string(id))) {
+        return false;
+    }
+    
+    dictionaries.setActive(id);
     return true;
 }
 
-bool Diary::loadFromFile() {
-    // Load user data
+void Diary::setMemoryBudget(size_t bytes) {
+    std::vector<std::uint64_t> evicted;
+    bodyCache.setBudget(bytes, evicted);
+    dropBodies(evicted);
+}
+
+BodyCache::Stats Diary::getCacheStats() const {
+    return bodyCache.getStats();
+}
+
+std::string Diary::getUserFilePath() const {
+    return storageDirectory + "/user.dat";
+}
+
+std::string Diary::getEntriesFilePath() const {
+    return storageDirectory + "/entries.dat";
+}
+
+std::string Diary::getSegmentsDirectory() const {
+    return storageDirectory + "/segments";
+}
+
+std::string Diary::getChunksDirectory() const {
+    return storageDirectory + "/chunks";
+}
+
+std::string Diary::getRevisionsDirectory() const {
+    return storageDirectory + "/revisions";
+}
+
+std::string Diary::getDictionaryDirectory() const {
+    return storageDirectory + "/dictionaries";
+}
+
+std::string Diary::getIndexSnapshotPath() const {
+    return storageDirectory + "/index.snap";
+}
+
+std::string Diary::getSegmentFiltersPath() const {
+    return storageDirectory + "/segments.bloom";
+}
+
+void Diary::loadDictionaries() {
+    std::error_code ec;
+    const SecureString& key = currentUser->getEncryptionKey();
+    dictionaries.clear();
+    for (const auto& file : fs::directory_iterator(getDictionaryDirectory(), ec)) {
+        if (file.path().extension() != ".dict") {
+            continue;
+        }
+        std::ifstream dictionaryFile(file.path());
+        std::stringstream buffer;
+        buffer << dictionaryFile.rdbuf();
+        dictionaries.add(Encryption::decrypt(buffer.str(), key));
+    }
+    
+    std::ifstream activeFile(getDictionaryDirectory() + "/active");
+    std::uint32_t active = 0;
+    if (activeFile >> active) {
+        dictionaries.setActive(active);
+    }
+}
+
+bool Diary::loadUser() {
     std::ifstream userFile(getUserFilePath());
     if (!userFile) {
-        return false;
+        return false; // User doesn't exist
     }
     
     std::stringstream userBuffer;
     userBuffer << userFile.rdbuf();
     currentUser = std::make_shared<User>(User::deserialize(userBuffer.str()));
-    userFile.close();
+    return true;
+}
+
+bool Diary::loadEntries() {
+    if (!store->open() || !chunkStore->open() || !revisionStore->open() || !importLegacyEntries()) {
+        return false;
+    }
     
-    // Load entries
-    std::ifstream entriesFile(getEntriesFilePath());
-    if (entriesFile) {
+    // Current saved filters are used as they are; otherwise the scan
+    // rebuilds them from the bodies it decrypts anyway
+    bool filtersLoaded = loadSegmentFilters();
+    entries.clear();
+    if (!scanEntries(!filtersLoaded)) {
         entries.clear();
-        size_t entryCount;
-        entriesFile >> entryCount;
-        entriesFile.ignore(); // Skip newline
-        
-        std::string entryData;
-        std::string line;
-        
-        for (size_t i = 0; i < entryCount; ++i) {
-            entryData.clear();
-            while (std::getline(entriesFile, line) && line != "---END_ENTRY---") {
-                entryData += line + "\n";
+        return false;
+    }
+    
+    // Scans follow file order and workers finish out of turn; everything
+    // else expects id order
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.getId() < b.getId(); });
+    if (!restoreIndexes()) {
+        rebuildIndexes();
+    }
+    if (filtersLoaded) {
+        for (const auto& entry : entries) {
+            placeEntry(entry.getId(), store->getSegment(entry.getId()));
+        }
+    }
+    
+    // Chunks no entry refers to are left over from an interrupted write
+    return chunkStore->collectGarbage();
+}
+
+bool Diary::scanEntries(bool buildFilters) {
+    // When logged in, entries are decrypted as they arrive, while the store
+    // is already reading the next batch
+    bool authenticated = currentUser && currentUser->isAuthenticated();
+    buildFilters = buildFilters && authenticated;
+    std::string_view key = authenticated ? std::string_view(currentUser->getEncryptionKey()) : std::string_view();
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), kMaxLoadThreads);
+    
+    if (threads < 2 || store->getRecordCount() < kParallelLoadThreshold) {
+        SecureString content;
+        return store->scan([&](std::uint64_t id, std::string_view payload) {
+            entries.push_back(Entry::deserialize(payload));
+            Entry& entry = entries.back();
+            entry.setId(id);
+            chunkStore->adopt(id, entry.getChunks());
+            if (authenticated) {
+                decryptEntry(entry, key, content);
+                if (buildFilters) {
+                    filterEntry(entry);
+                }
+                admitBody(entry);
             }
-            if (!entryData.empty()) {
-                entries.push_back(Entry::deserialize(entryData));
+        });
+    }
+    
+    // Large diaries run as a pipeline: this thread hands raw records from the
+    // scan to parser workers, which pass entries on to decrypt workers, so a
+    // load takes about as long as its slowest stage instead of all three
+    size_t parserCount = std::max<size_t>(1, threads / 3);
+    size_t decryptorCount = std::max<size_t>(1, threads - parserCount);
+    BoundedQueue<LoadRecord> parseQueue(kLoadQueueCapacity);
+    BoundedQueue<Entry> decryptQueue(kLoadQueueCapacity);
+    std::atomic<size_t> parsersLeft(parserCount);
+    std::vector<std::vector<Entry>> decrypted(decryptorCount);
+    // Each decryptor fills its own filters, merged once they are joined
+    std::vector<SegmentFilters> filters(decryptorCount);
+    std::vector<std::vector<std::pair<std::uint64_t, std::uint32_t>>> placements(decryptorCount);
+    
+    // A stage that throws closes both queues so the others wind down; the
+    // first exception is rethrown here once every thread has been joined
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto fail = [&] {
+        {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
             }
         }
+        parseQueue.close();
+        decryptQueue.close();
+    };
+    
+    std::vector<std::thread> parsers;
+    for (size_t i = 0; i < parserCount; ++i) {
+        parsers.emplace_back([&] {
+            try {
+                LoadRecord record;
+                while (parseQueue.pop(record)) {
+                    Entry entry = Entry::deserialize(record.payload);
+                    entry.setId(record.id);
+                    chunkStore->adopt(record.id, entry.getChunks());
+                    if (!decryptQueue.push(std::move(entry))) {
+                        break;
+                    }
+                }
+            } catch (...) {
+                fail();
+            }
+            if (parsersLeft.fetch_sub(1) == 1) {
+                decryptQueue.close();
+            }
+        });
+    }
+    std::vector<std::thread> decryptors;
+    for (size_t i = 0; i < decryptorCount; ++i) {
+        decryptors.emplace_back([&, i] {
+            try {
+                Entry entry;
+                SecureString content;
+                while (decryptQueue.pop(entry)) {
+                    if (authenticated) {
+                        decryptEntry(entry, key, content);
+                        if (buildFilters) {
+                            placements[i].emplace_back(entry.getId(), addToFilter(filters[i], entry, key));
+                        }
+                        admitBody(entry);
+                    }
+                    decrypted[i].push_back(std::move(entry));
+                }
+            } catch (...) {
+                fail();
+            }
+        });
+    }
+    
+    bool scanned = false;
+    try {
+        scanned = store->scan([&](std::uint64_t id, std::string_view payload) {
+            parseQueue.push(LoadRecord{id, std::string(payload)}); // Dropped once a stage has failed
+        });
+    } catch (...) {
+        fail();
+    }
+    parseQueue.close();
+    for (auto& parser : parsers) {
+        parser.join();
+    }
+    for (auto& decryptor : decryptors) {
+        decryptor.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
     }
     
+    for (auto& part : decrypted) {
+        std::move(part.begin(), part.end(), std::back_inserter(entries));
+    }
+    for (size_t i = 0; i < decryptorCount; ++i) {
+        for (auto& filter : filters[i]) {
+            auto merged = segmentFilters.emplace(filter.first, filter.second);
+            if (!merged.second) {
+                merged.first->second.merge(filter.second);
+            }
+        }
+        for (const auto& placement : placements[i]) {
+            placeEntry(placement.first, placement.second);
+        }
+    }
+    return scanned;
+}
+
+bool Diary::persistEntry(const Entry& entry) {
+    // Entries only ever reach the disk in encrypted form
+    Entry record = entry;
+    bool authenticated = currentUser && currentUser->isAuthenticated();
+    std::vector<std::string> hashes;
+    if (authenticated) {
+        const SecureString& key = currentUser->getEncryptionKey();
+        if (!entry.isEncrypted() && entry.getContent().size() >= kMinChunkedContentSize) {
+            // Store the body as a chunk list so repeated text is kept once
+            if (!chunkStore->assign(entry.getContent(), key, hashes)) {
+                return false;
+            }
+            record.setContent("");
+            record.setChunks(hashes);
+        } else {
+            record.setChunks({});
+        }
+        record.encrypt(key, &dictionaries);
+    }
+    
+    if (!store->put(entry.getId(), record.serialize())) {
+        chunkStore->abandon(hashes);
+        return false;
+    }
+    filterEntry(entry);
+    if (!store->sync()) {
+        // Either record may be the one on disk, so both keep their chunks
+        chunkStore->retain(entry.getId(), hashes);
+        return false;
+    }
+    
+    // Chunks the previous version used are dropped only once the new record is durable
+    if (authenticated) {
+        chunkStore->commit(entry.getId(), hashes);
+    }
+    return chunkStore->collectGarbage();
+}
+
+bool Diary::importLegacyEntries() {
+    // Older versions rewrote the whole diary into entries.dat on every change
+    std::ifstream entriesFile(getEntriesFilePath(), std::ios::binary);
+    if (!entriesFile) {
+        return true;
+    }
+    std::stringstream buffer;
+    buffer << entriesFile.rdbuf();
+    entriesFile.close();
+    const std::string data = buffer.str();
+    
+    size_t offset = data.find('\n');
+    size_t entryCount = 0;
+    std::from_chars(data.data(), data.data() + std::min(offset, data.size()), entryCount);
+    offset = offset == std::string::npos ? data.size() : offset + 1;
+    
+    // Each entry runs up to a line holding only the end marker; entries are
+    // parsed in place rather than reassembled line by line
+    const std::string_view endMarker = "---END_ENTRY---";
+    for (size_t i = 0; i < entryCount && offset < data.size(); ++i) {
+        size_t end = offset;
+        size_t next = data.size();
+        while (end < data.size()) {
+            size_t newline = data.find('\n', end);
+            size_t lineEnd = newline == std::string::npos ? data.size() : newline;
+            if (std::string_view(data).substr(end, lineEnd - end) == endMarker) {
+                next = lineEnd == data.size() ? lineEnd : lineEnd + 1;
+                break;
+            }
+            end = lineEnd == data.size() ? lineEnd : lineEnd + 1;
+        }
+        if (end > offset) {
+            Entry entry = Entry::deserialize(std::string_view(data).substr(offset, end - offset));
+            if (!store->put(store->allocateId(), entry.serialize())) {
+                return false;
+            }
+        }
+        offset = next;
+    }
+    
+    if (!store->sync()) {
+        return false;
+    }
+    std::error_code ec;
+    fs::remove(getEntriesFilePath(), ec);
     return true;
 }
 
-std::string Diary::getUserFilePath() const {
-    return storageDirectory + "/user.dat";
+void Diary::indexEntry(const Entry& entry) {
+    timeIndex.emplace(entry.getTimestamp(), entry.getId());
+    tagIndex[entry.getTags()].insert(entry.getId());
 }
 
-std::string Diary::getEntriesFilePath() const {
-    return storageDirectory + "/entries.dat";
+void Diary::unindexEntry(const Entry& entry) {
+    timeIndex.erase({entry.getTimestamp(), entry.getId()});
+    auto tags = tagIndex.find(entry.getTags());
+    if (tags != tagIndex.end()) {
+        tags->second.erase(entry.getId());
+        if (tags->second.empty()) {
+            tagIndex.erase(tags);
+        }
+    }
+}
+
+void Diary::rebuildIndexes() {
+    timeIndex.clear();
+    tagIndex.clear();
+    idIndex.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        indexEntry(entries[i]);
+        idIndex[entries[i].getId()] = i;
+    }
 }
 
-void Diary::encryptEntries() {
+bool Diary::restoreIndexes() {
     if (!currentUser || !currentUser->isAuthenticated()) {
-        return;
+        return false;
     }
     
-    std::string key = currentUser->getEncryptionKey();
-    for (auto& entry : entries) {
-        if (!entry.isEncrypted()) {
-            entry.encrypt(key);
+    idIndex.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        idIndex[entries[i].getId()] = i;
+    }
+    if (!IndexSnapshot::load(getIndexSnapshotPath(), currentUser->getEncryptionKey(),
+                             store->getGeneration(), timeIndex, tagIndex)) {
+        return false;
+    }
+    
+    // The generation already pins the snapshot to this store; make sure it
+    // also indexes every loaded entry under its own timestamp and tags, and
+    // nothing else. Each entry is found once in each index, so equal totals
+    // leave no room for extra postings.
+    if (timeIndex.size() != entries.size()) {
+        return false;
+    }
+    size_t postings = 0;
+    for (const auto& tags : tagIndex) {
+        postings += tags.second.size();
+    }
+    if (postings != entries.size()) {
+        return false;
+    }
+    for (const auto& entry : entries) {
+        auto tags = tagIndex.find(entry.getTags());
+        if (timeIndex.count({entry.getTimestamp(), entry.getId()}) == 0 || tags == tagIndex.end() ||
+            tags->second.count(entry.getId()) == 0) {
+            return false;
         }
     }
+    return true;
 }
 
-void Diary::decryptEntries() {
+void Diary::filterEntry(const Entry& entry) {
     if (!currentUser || !currentUser->isAuthenticated()) {
         return;
     }
+    placeEntry(entry.getId(), addToFilter(segmentFilters, entry, currentUser->getEncryptionKey()));
+}
+
+std::uint32_t Diary::addToFilter(SegmentFilters& filters, const Entry& entry, std::string_view key) const {
+    std::uint32_t segment = store->getSegment(entry.getId());
+    if (segment == 0) {
+        return 0;
+    }
     
-    std::string key = currentUser->getEncryptionKey();
-    for (auto& entry : entries) {
-        if (entry.isEncrypted()) {
-            entry.decrypt(key);
+    auto filter = filters.find(segment);
+    if (filter == filters.end()) {
+        filter = filters.emplace(segment, BloomFilter(BloomFilter::seedFromKey(key))).first;
+    }
+    // Filters only ever gain bits: text an entry no longer has, or that
+    // compaction dropped, costs false positives but never a missed match
+    filter->second.addText(entry.getTitle());
+    if (!entry.isEncrypted()) {
+        filter->second.addText(entry.getContent());
+    }
+    return segment;
+}
+
+void Diary::placeEntry(std::uint64_t id, std::uint32_t segment) {
+    auto placed = entrySegments.emplace(id, segment);
+    if (!placed.second) {
+        if (placed.first->second == segment) {
+            return;
         }
+        unplaceEntry(id);
+        entrySegments.emplace(id, segment);
     }
-} 
\ No newline at end of file
+    segmentEntries[segment].insert(id);
+}
+
+void Diary::unplaceEntry(std::uint64_t id) {
+    auto placed = entrySegments.find(id);
+    if (placed == entrySegments.end()) {
+        return;
+    }
+    auto members = segmentEntries.find(placed->second);
+    members->second.erase(id);
+    if (members->second.empty()) {
+        segmentEntries.erase(members);
+    }
+    entrySegments.erase(placed);
+}
+
+bool Diary::loadSegmentFilters() {
+    segmentFilters.clear();
+    entrySegments.clear();
+    segmentEntries.clear();
+    if (!currentUser || !currentUser->isAuthenticated()) {
+        return false;
+    }
+    
+    // Saved filters are only trusted at the generation they were saved at,
+    // since later writes may have added text they do not cover
+    return BloomFilter::load(getSegmentFiltersPath(), currentUser->getEncryptionKey(), store->getGeneration(),
+                             segmentFilters);
+}
+
+bool Diary::decryptEntry(Entry& entry, std::string_view key, SecureString& content) const {
+    if (entry.isEncrypted()) {
+        entry.decrypt(key, &dictionaries);
+    }
+    if (!entry.isEncrypted() && !entry.getChunks().empty()) {
+        // A missing or damaged chunk leaves the chunk list in place, which
+        // keeps the entry marked unreadable rather than silently empty
+        if (!chunkStore->assemble(entry.getChunks(), key, content)) {
+            content.clear();
+            return false;
+        }
+        entry.setContent(content);
+        entry.setChunks({});
+    }
+    return !isPinned(entry);
+}
+
+bool Diary::isPinned(const Entry& entry) const {
+    // Bodies that could not be decoded stay as they are, outside the cache;
+    // reading them back would fail the same way
+    return entry.isEncrypted() || !entry.getChunks().empty();
+}
+
+void Diary::admitBody(Entry& entry) {
+    if (!isPinned(entry) && !bodyCache.admit(entry.getId(), entry.getContent().size())) {
+        entry.releaseContent();
+    }
+}
+
+void Diary::cacheBody(const Entry& entry) {
+    if (isPinned(entry)) {
+        return;
+    }
+    std::vector<std::uint64_t> evicted;
+    bodyCache.insert(entry.getId(), entry.getContent().size(), evicted);
+    dropBodies(evicted);
+}
+
+void Diary::dropBodies(const std::vector<std::uint64_t>& ids) {
+    // The encrypted record in the store is the spilled copy
+    for (std::uint64_t id : ids) {
+        auto position = idIndex.find(id);
+        if (position != idIndex.end()) {
+            entries[position->second].releaseContent();
+        }
+    }
+}
+
+bool Diary::loadBody(const Entry& entry, SecureString& content) const {
+    std::string payload;
+    if (!currentUser || !currentUser->isAuthenticated() || !store->get(entry.getId(), payload)) {
+        return false;
+    }
+    
+    Entry stored = Entry::deserialize(payload);
+    if (!decryptEntry(stored, currentUser->getEncryptionKey(), content)) {
+        return false;
+    }
+    content.assign(stored.getContent().data(), stored.getContent().size());
+    return true;
+}
+
+void Diary::fillBody(Entry& copy) const {
+    // Bulk reads check residency without marking bodies recently used, so
+    // one pass over everything does not look like a working set
+    if (isPinned(copy) || bodyCache.contains(copy.getId())) {
+        return;
+    }
+    SecureString body;
+    if (loadBody(copy, body)) {
+        copy.setContent(body);
+    }
+}
+
+bool Diary::ensureResident(Entry& entry) {
+    if (isPinned(entry)) {
+        return false;
+    }
+    if (bodyCache.touch(entry.getId())) {
+        return true;
+    }
+    SecureString body;
+    if (!loadBody(entry, body)) {
+        return false;
+    }
+    entry.setContent(body);
+    cacheBody(entry);
+    return true;
+}
@@ -0,0 +1,227 @@
+#include "../include/DiaryClient.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+DiaryClient::DiaryClient()
+    : fd(-1), nextRequestId(1), prefetchPending(false), prefetchRequest(0), prefetchSize(0) {}
+
+DiaryClient::~DiaryClient() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool DiaryClient::connect(const std::string& socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool DiaryClient::isConnected() const {
+    return fd >= 0;
+}
+
+std::uint32_t DiaryClient::submit(Protocol::Opcode opcode, const std::string& body) {
+    std::uint32_t requestId = nextRequestId++;
+    std::string frame;
+    Protocol::appendFrame(frame, opcode, requestId, body);
+
+    size_t written = 0;
+    while (fd >= 0 && written < frame.size()) {
+        // A daemon that went away shows up as EPIPE rather than SIGPIPE
+        ssize_t n = ::send(fd, frame.data() + written, frame.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            fd = -1;
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return requestId;
+}
+
+bool DiaryClient::receive(std::uint32_t requestId, Protocol::Frame& response) {
+    // Responses arrive in request order; earlier ones nobody waits for
+    // (an abandoned prefetch) are skipped
+    char buffer[64 * 1024];
+    while (fd >= 0) {
+        size_t offset = 0;
+        bool malformed = false;
+        while (Protocol::extractFrame(input, offset, response, malformed)) {
+            if (response.requestId == requestId) {
+                input.erase(0, offset);
+                return true;
+            }
+        }
+        input.erase(0, offset);
+        if (malformed) {
+            break;
+        }
+
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        input.append(buffer, static_cast<size_t>(n));
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return false;
+}
+
+bool DiaryClient::registerUser(const std::string& username, const std::string& password) {
+    std::string body;
+    Protocol::writeString(body, username);
+    Protocol::writeString(body, password);
+    Protocol::Frame response;
+    return call(Protocol::Register, body, response);
+}
+
+bool DiaryClient::loginUser(const std::string& username, const std::string& password) {
+    std::string body;
+    Protocol::writeString(body, username);
+    Protocol::writeString(body, password);
+    Protocol::Frame response;
+    return call(Protocol::Login, body, response);
+}
+
+void DiaryClient::logoutUser() {
+    Protocol::Frame response;
+    call(Protocol::Logout, std::string(), response);
+}
+
+bool DiaryClient::addEntry(const Entry& entry) {
+    std::string body;
+    Protocol::writeEntry(body, entry);
+    Protocol::Frame response;
+    return call(Protocol::AddEntry, body, response);
+}
+
+bool DiaryClient::deleteEntry(const std::string& title) {
+    std::string body;
+    Protocol::writeString(body, title);
+    Protocol::Frame response;
+    return call(Protocol::DeleteEntry, body, response);
+}
+
+bool DiaryClient::updateEntry(const std::string& title, const Entry& newEntry) {
+    std::string body;
+    Protocol::writeString(body, title);
+    Protocol::writeEntry(body, newEntry);
+    Protocol::Frame response;
+    return call(Protocol::UpdateEntry, body, response);
+}
+
+Entry* DiaryClient::getEntry(const std::string& title) {
+    std::string body;
+    Protocol::writeString(body, title);
+    Protocol::Frame response;
+    if (!call(Protocol::GetEntry, body, response)) {
+        return nullptr;
+    }
+    Protocol::Reader reader(response.body);
+    return reader.readEntry(fetchedEntry) ? &fetchedEntry : nullptr;
+}
+
+bool DiaryClient::nextPage(EntryCursor& cursor, size_t pageSize, std::vector<Entry>& page) {
+    page.clear();
+    std::uint32_t requestId;
+    if (prefetchPending && prefetchSize == pageSize && prefetchCursor.started == cursor.started &&
+        prefetchCursor.timestamp == cursor.timestamp && prefetchCursor.id == cursor.id) {
+        requestId = prefetchRequest;
+    } else {
+        requestId = submitPage(cursor, pageSize);
+    }
+    prefetchPending = false;
+
+    Protocol::Frame response;
+    if (!receive(requestId, response) || response.code != Protocol::Ok) {
+        return false;
+    }
+    Protocol::Reader reader(response.body);
+    if (!reader.readEntries(page) || page.empty()) {
+        return false;
+    }
+
+    const Entry& last = page.back();
+    cursor.timestamp = last.getTimestamp();
+    cursor.id = last.getId();
+    cursor.started = true;
+
+    // Ask for the following page now so it is ready when the user continues
+    if (page.size() == pageSize) {
+        prefetchRequest = submitPage(cursor, pageSize);
+        prefetchCursor = cursor;
+        prefetchSize = pageSize;
+        prefetchPending = true;
+    }
+    return true;
+}
+
+std::vector<Entry> DiaryClient::searchByDate(const std::time_t& date) {
+    std::string body;
+    Protocol::writeU64(body, static_cast<std::uint64_t>(date));
+    return search(Protocol::SearchByDate, body);
+}
+
+std::vector<Entry> DiaryClient::searchByKeyword(const std::string& keyword) {
+    std::string body;
+    Protocol::writeString(body, keyword);
+    return search(Protocol::SearchByKeyword, body);
+}
+
+std::vector<Entry> DiaryClient::searchByTag(const std::string& tag) {
+    std::string body;
+    Protocol::writeString(body, tag);
+    return search(Protocol::SearchByTag, body);
+}
+
+bool DiaryClient::call(Protocol::Opcode opcode, const std::string& body, Protocol::Frame& response) {
+    prefetchPending = false;
+    return receive(submit(opcode, body), response) && response.code == Protocol::Ok;
+}
+
+std::vector<Entry> DiaryClient::search(Protocol::Opcode opcode, const std::string& body) {
+    std::vector<Entry> results;
+    Protocol::Frame response;
+    if (call(opcode, body, response)) {
+        Protocol::Reader reader(response.body);
+        if (!reader.readEntries(results)) {
+            results.clear();
+        }
+    }
+    return results;
+}
+
+std::uint32_t DiaryClient::submitPage(const EntryCursor& cursor, size_t pageSize) {
+    std::string body;
+    Protocol::writeU64(body, static_cast<std::uint64_t>(cursor.timestamp));
+    Protocol::writeU64(body, cursor.id);
+    Protocol::writeU32(body, cursor.started ? 1 : 0);
+    Protocol::writeU32(body, static_cast<std::uint32_t>(pageSize));
+    return submit(Protocol::NextPage, body);
+}
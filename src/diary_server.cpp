@@ -0,0 +1,321 @@
+#include "../include/DiaryServer.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const int kMaxEvents = 64;
+const int kTickMillis = 1000;
+const size_t kReadChunk = 64 * 1024;
+const size_t kMaxPendingOutput = 8 * 1024 * 1024; // Stop reading a client that does not drain
+const size_t kMaxPageSize = 1000;
+const auto kDefaultIdleTimeout = std::chrono::seconds(15 * 60);
+
+} // namespace
+
+DiaryServer::DiaryServer(Diary& diary, const std::string& socketPath)
+    : diary(diary), socketPath(socketPath), listenFd(-1), epollFd(-1), running(false),
+      idleTimeout(kDefaultIdleTimeout), lastActivity(std::chrono::steady_clock::now()), warm(false) {}
+
+DiaryServer::~DiaryServer() {
+    for (auto& connection : connections) {
+        ::close(connection.first);
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+}
+
+bool DiaryServer::start() {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+
+    // Only the owner may talk to a daemon holding decrypted entries
+    ::unlink(socketPath.c_str());
+    mode_t previousMask = ::umask(0077);
+    int bound = ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previousMask);
+    if (bound < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+        return false;
+    }
+
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        return false;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    running = ::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+    return running;
+}
+
+void DiaryServer::run() {
+    epoll_event events[kMaxEvents];
+
+    while (running) {
+        int count = ::epoll_wait(epollFd, events, kMaxEvents, kTickMillis);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            Connection& connection = it->second;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) ||
+                ((events[i].events & EPOLLIN) && !readInput(connection))) {
+                closeConnection(fd);
+                continue;
+            }
+            if (!processRequests(connection) || !flush(connection)) {
+                closeConnection(fd);
+                continue;
+            }
+            updateInterest(connection);
+        }
+
+        evictIfIdle();
+    }
+}
+
+void DiaryServer::stop() {
+    running = false;
+}
+
+void DiaryServer::setIdleTimeout(std::chrono::seconds timeout) {
+    idleTimeout = timeout;
+}
+
+void DiaryServer::acceptConnections() {
+    while (true) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return; // EAGAIN: backlog drained
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ::close(fd);
+            continue;
+        }
+        connections[fd] = Connection{fd, std::string(), std::string(), false};
+    }
+}
+
+bool DiaryServer::readInput(Connection& connection) {
+    char buffer[kReadChunk];
+    while (true) {
+        ssize_t n = ::read(connection.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            connection.input.append(buffer, static_cast<size_t>(n));
+        } else if (n == 0) {
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool DiaryServer::processRequests(Connection& connection) {
+    // Answer every complete request in the buffer, in order, until the
+    // client falls too far behind reading the responses
+    size_t offset = 0;
+    Protocol::Frame request;
+    bool malformed = false;
+    std::string body;
+    while (connection.output.size() < kMaxPendingOutput &&
+           Protocol::extractFrame(connection.input, offset, request, malformed)) {
+        body.clear();
+        Protocol::Status status = dispatch(connection, request, body);
+        Protocol::appendFrame(connection.output, status, request.requestId, body);
+    }
+    if (offset > 0) {
+        connection.input.erase(0, offset);
+        lastActivity = std::chrono::steady_clock::now();
+    }
+    return !malformed;
+}
+
+bool DiaryServer::flush(Connection& connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        // MSG_NOSIGNAL: a client gone with output still queued is an
+        // ordinary close (EPIPE), not a SIGPIPE that kills the daemon
+        ssize_t n = ::send(connection.fd, connection.output.data() + written,
+                           connection.output.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    connection.output.erase(0, written);
+    return true;
+}
+
+void DiaryServer::updateInterest(Connection& connection) {
+    epoll_event event{};
+    event.events = 0;
+    if (connection.output.size() < kMaxPendingOutput) {
+        event.events |= EPOLLIN;
+    }
+    if (!connection.output.empty()) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = connection.fd;
+    ::epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void DiaryServer::closeConnection(int fd) {
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+}
+
+Protocol::Status DiaryServer::dispatch(Connection& connection, const Protocol::Frame& request,
+                                       std::string& body) {
+    Protocol::Reader reader(request.body);
+
+    switch (request.code) {
+        case Protocol::Register:
+        case Protocol::Login: {
+            std::string username;
+            std::string password;
+            if (!reader.readString(username) || !reader.readString(password)) {
+                return Protocol::BadRequest;
+            }
+            if (request.code == Protocol::Register) {
+                return diary.registerUser(username, password) ? Protocol::Ok : Protocol::Failed;
+            }
+            connection.authenticated = diary.loginUser(username, password);
+            warm = warm || connection.authenticated;
+            return connection.authenticated ? Protocol::Ok : Protocol::Failed;
+        }
+        case Protocol::Logout:
+            // The diary itself stays loaded for the next session
+            connection.authenticated = false;
+            return Protocol::Ok;
+        default:
+            break;
+    }
+
+    if (!connection.authenticated) {
+        return Protocol::Unauthorized;
+    }
+
+    std::string text;
+    std::vector<Entry> results;
+    switch (request.code) {
+        case Protocol::AddEntry:
+        case Protocol::UpdateEntry: {
+            Entry entry;
+            if (request.code == Protocol::UpdateEntry && !reader.readString(text)) {
+                return Protocol::BadRequest;
+            }
+            if (!reader.readEntry(entry)) {
+                return Protocol::BadRequest;
+            }
+            bool ok = request.code == Protocol::AddEntry ? diary.addEntry(entry)
+                                                         : diary.updateEntry(text, entry);
+            return ok ? Protocol::Ok : Protocol::Failed;
+        }
+        case Protocol::DeleteEntry:
+            if (!reader.readString(text)) {
+                return Protocol::BadRequest;
+            }
+            return diary.deleteEntry(text) ? Protocol::Ok : Protocol::Failed;
+        case Protocol::GetEntry: {
+            if (!reader.readString(text)) {
+                return Protocol::BadRequest;
+            }
+            Entry* entry = diary.getEntry(text);
+            if (!entry) {
+                return Protocol::Failed;
+            }
+            Protocol::writeEntry(body, *entry);
+            return Protocol::Ok;
+        }
+        case Protocol::NextPage: {
+            EntryCursor cursor;
+            std::uint64_t timestamp;
+            std::uint32_t started;
+            std::uint32_t pageSize;
+            if (!reader.readU64(timestamp) || !reader.readU64(cursor.id) || !reader.readU32(started) ||
+                !reader.readU32(pageSize)) {
+                return Protocol::BadRequest;
+            }
+            cursor.timestamp = static_cast<std::time_t>(timestamp);
+            cursor.started = started != 0;
+            diary.nextPage(cursor, std::min<size_t>(pageSize, kMaxPageSize), results);
+            Protocol::writeEntries(body, results);
+            return Protocol::Ok;
+        }
+        case Protocol::SearchByDate: {
+            std::uint64_t date;
+            if (!reader.readU64(date)) {
+                return Protocol::BadRequest;
+            }
+            Protocol::writeEntries(body, diary.searchByDate(static_cast<std::time_t>(date)));
+            return Protocol::Ok;
+        }
+        case Protocol::SearchByKeyword:
+        case Protocol::SearchByTag:
+            if (!reader.readString(text)) {
+                return Protocol::BadRequest;
+            }
+            Protocol::writeEntries(body, request.code == Protocol::SearchByKeyword
+                                             ? diary.searchByKeyword(text)
+                                             : diary.searchByTag(text));
+            return Protocol::Ok;
+        default:
+            return Protocol::BadRequest;
+    }
+}
+
+void DiaryServer::evictIfIdle() {
+    if (!warm || std::chrono::steady_clock::now() - lastActivity < idleTimeout) {
+        return;
+    }
+    for (const auto& connection : connections) {
+        if (connection.second.authenticated) {
+            return;
+        }
+    }
+
+    // Drops and wipes everything that was decrypted
+    diary.logoutUser();
+    warm = false;
+}
@@ -1,48 +1,50 @@
 #include "../include/Encryption.hpp"
 #include <random>
-#include <sstream>
-#include <iomanip>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 
-// XOR-based encryption (for demonstration - in production, use a proper encryption library)
-std::string Encryption::encrypt(const std::string& data, const std::string& key) {
-    std::string paddedKey = padKey(key, data.length());
-    std::string result = data;
-    
-    for (size_t i = 0; i < data.length(); ++i) {
-        result[i] = data[i] ^ paddedKey[i];
+// XOR-based encryption (for demonstration - in production, use a proper encryption library).
+// The key is read in place, so no copy of it is made.
+std::string Encryption::encrypt(std::string_view data, std::string_view key) {
+    std::vector<unsigned char> result(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        unsigned char pad = key.empty() ? 0 : static_cast<unsigned char>(key[i % key.size()]);
+        result[i] = static_cast<unsigned char>(data[i]) ^ pad;
     }
     
-    return base64Encode(std::vector<unsigned char>(result.begin(), result.end()));
+    return base64Encode(result);
 }
 
-std::string Encryption::decrypt(const std::string& encryptedData, const std::string& key) {
-    std::vector<unsigned char> decodedData = base64Decode(encryptedData);
-    std::string data(decodedData.begin(), decodedData.end());
-    std::string paddedKey = padKey(key, data.length());
-    std::string result = data;
-    
-    for (size_t i = 0; i < data.length(); ++i) {
-        result[i] = data[i] ^ paddedKey[i];
+SecureString Encryption::decrypt(std::string_view encryptedData, std::string_view key) {
+    std::vector<unsigned char> data = base64Decode(encryptedData);
+    SecureString result(data.size(), '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        unsigned char pad = key.empty() ? 0 : static_cast<unsigned char>(key[i % key.size()]);
+        result[i] = static_cast<char>(data[i] ^ pad);
     }
     
     return result;
 }
 
-std::string Encryption::hashString(const std::string& input) {
+std::string Encryption::hashString(std::string_view input) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
     SHA256_CTX sha256;
     SHA256_Init(&sha256);
-    SHA256_Update(&sha256, input.c_str(), input.length());
+    SHA256_Update(&sha256, input.data(), input.size());
     SHA256_Final(hash, &sha256);
-    
-    std::stringstream ss;
+
+    // Formatted in place: the digest is a key for some callers, and a
+    // stream would leave copies of it in buffers nobody wipes
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * SHA256_DIGEST_LENGTH, '\0');
     for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+        hex[2 * i] = digits[hash[i] >> 4];
+        hex[2 * i + 1] = digits[hash[i] & 0x0F];
     }
-    return ss.str();
+    secureZero(hash, sizeof(hash));
+    secureZero(&sha256, sizeof(sha256));
+    return hex;
 }
 
 std::string Encryption::generateKey(const std::string& seed) {
@@ -95,7 +97,7 @@ std::string Encryption::base64Encode(const std::vector<unsigned char>& data) {
     return ret;
 }
 
-std::vector<unsigned char> Encryption::base64Decode(const std::string& encoded) {
+std::vector<unsigned char> Encryption::base64Decode(std::string_view encoded) {
     static const std::string base64_chars = 
         "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     
@@ -150,17 +152,24 @@ std::vector<unsigned char> Encryption::base64Decode(const std::string& encoded)
     return ret;
 }
 
-std::string Encryption::padKey(const std::string& key, size_t length) {
-    if (key.empty()) return std::string(length, '\0');
-    
-    std::string result;
-    result.reserve(length);
-    
+std::uint32_t Encryption::crc32(const char* data, size_t length) {
+    static const auto table = [] {
+        std::vector<std::uint32_t> t(256);
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
     for (size_t i = 0; i < length; ++i) {
-        result += key[i % key.length()];
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
     }
-    
-    return result;
+    return crc ^ 0xFFFFFFFFu;
 }
 
 unsigned char Encryption::getRandom() {
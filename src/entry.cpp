@@ -1,19 +1,52 @@
 #include "../include/Entry.hpp"
 #include "../include/Encryption.hpp"
-#include <sstream>
-#include <iomanip>
+#include "../include/Compression.hpp"
+#include "../include/DateFormatter.hpp"
+#include <charconv>
 #include <ctime>
 
-Entry::Entry() : timestamp(std::time(nullptr)), encrypted(false) {}
+namespace {
+
+// Returns the text up to the next newline (all of it if there is none)
+// and advances past that newline
+std::string_view nextLine(std::string_view& data) {
+    size_t newline = data.find('\n');
+    std::string_view line = data.substr(0, newline);
+    data.remove_prefix(newline == std::string_view::npos ? data.size() : newline + 1);
+    return line;
+}
+
+// Parses the next space-separated integer, leaving `value` alone on failure
+template <typename T>
+bool parseNumber(std::string_view& text, T& value) {
+    size_t start = text.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        return false;
+    }
+    auto result = std::from_chars(text.data() + start, text.data() + text.size(), value);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    text.remove_prefix(static_cast<size_t>(result.ptr - text.data()));
+    return true;
+}
+
+bool hasMore(std::string_view text) {
+    return text.find_first_not_of(' ') != std::string_view::npos;
+}
+
+} // namespace
+
+Entry::Entry() : timestamp(std::time(nullptr)), encrypted(false), id(0), codec(Compression::None) {}
 
 Entry::Entry(const std::string& title, const std::string& content)
-    : title(title), content(content), timestamp(std::time(nullptr)), encrypted(false) {}
+    : title(title), content(content.data(), content.size()), timestamp(std::time(nullptr)), encrypted(false), id(0), codec(Compression::None) {}
 
 std::string Entry::getTitle() const {
     return title;
 }
 
-std::string Entry::getContent() const {
+std::string_view Entry::getContent() const {
     return content;
 }
 
@@ -29,60 +62,127 @@ bool Entry::isEncrypted() const {
     return encrypted;
 }
 
+std::uint64_t Entry::getId() const {
+    return id;
+}
+
+std::uint8_t Entry::getCodec() const {
+    return codec;
+}
+
+const std::vector<std::string>& Entry::getChunks() const {
+    return chunks;
+}
+
 void Entry::setTitle(const std::string& newTitle) {
     title = newTitle;
 }
 
-void Entry::setContent(const std::string& newContent) {
-    content = newContent;
+void Entry::setContent(std::string_view newContent) {
+    content.assign(newContent.data(), newContent.size());
 }
 
 void Entry::setTags(const std::string& newTags) {
     tags = newTags;
 }
 
-void Entry::encrypt(const std::string& key) {
+void Entry::setId(std::uint64_t newId) {
+    id = newId;
+}
+
+void Entry::setChunks(const std::vector<std::string>& newChunks) {
+    chunks = newChunks;
+}
+
+void Entry::encrypt(std::string_view key, const Compression::Dictionaries* dictionaries) {
     if (!encrypted) {
-        content = Encryption::encrypt(content, key);
+        SecureString compressed;
+        codec = Compression::compress(content, Compression::getDefaultCodec(), compressed, dictionaries);
+        std::string sealed = Encryption::encrypt(codec == Compression::None ? content : compressed, key);
+        content.assign(sealed.data(), sealed.size());
         encrypted = true;
     }
 }
 
-void Entry::decrypt(const std::string& key) {
+void Entry::decrypt(std::string_view key, const Compression::Dictionaries* dictionaries) {
     if (encrypted) {
-        content = Encryption::decrypt(content, key);
+        SecureString packed = Encryption::decrypt(content, key);
+        SecureString plain;
+        // Leave the entry encrypted if it cannot be decoded (e.g. missing dictionary)
+        if (!Compression::decompress(packed, static_cast<Compression::Codec>(codec), plain, dictionaries)) {
+            return;
+        }
+        content.swap(plain);
+        codec = Compression::None;
         encrypted = false;
     }
 }
 
+void Entry::releaseContent() {
+    SecureString().swap(content); // Releasing the buffer zeroes it
+}
+
 std::string Entry::getFormattedDate() const {
-    std::tm* timeinfo = std::localtime(&timestamp);
-    std::stringstream ss;
-    ss << std::put_time(timeinfo, "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+    char buffer[DateFormatter::BufferSize];
+    return std::string(buffer, formatDate(buffer, sizeof(buffer)));
+}
+
+size_t Entry::formatDate(char* buffer, size_t size) const {
+    return DateFormatter::format(timestamp, buffer, size);
 }
 
 std::string Entry::serialize() const {
-    std::stringstream ss;
-    ss << title << "\n"
-       << timestamp << "\n"
-       << tags << "\n"
-       << encrypted << "\n"
-       << content;
-    return ss.str();
+    std::string out;
+    out.reserve(title.size() + tags.size() + content.size() + chunks.size() * 65 + 48);
+    out += title;
+    out += '\n';
+    out += std::to_string(timestamp);
+    out += '\n';
+    out += tags;
+    out += '\n';
+    out += encrypted ? '1' : '0';
+    out += ' ';
+    out += std::to_string(codec);
+    out += ' ';
+    out += std::to_string(chunks.size());
+    out += '\n';
+    for (const auto& chunk : chunks) {
+        out += chunk;
+        out += '\n';
+    }
+    out.append(content.data(), content.size());
+    return out;
 }
 
-Entry Entry::deserialize(const std::string& data) {
-    std::stringstream ss(data);
+Entry Entry::deserialize(std::string_view data) {
+    // Single pass over the record; each field is copied out once. A record
+    // that does not parse yields an empty entry, as the stream parser did.
     Entry entry;
     
-    std::getline(ss, entry.title);
-    ss >> entry.timestamp;
-    ss.ignore(); // Skip newline
-    std::getline(ss, entry.tags);
-    ss >> entry.encrypted;
-    ss.ignore(); // Skip newline
-    std::getline(ss, entry.content, '\0'); // Read until the end
+    entry.title.assign(nextLine(data));
+    std::string_view stampLine = nextLine(data);
+    long long stamp = 0;
+    if (!parseNumber(stampLine, stamp)) {
+        return Entry();
+    }
+    entry.timestamp = static_cast<std::time_t>(stamp);
+    entry.tags.assign(nextLine(data));
+    
+    std::string_view flags = nextLine(data);
+    int encrypted = 0;
+    int codec = Compression::None; // Absent in entries written before compression
+    size_t chunkCount = 0;         // Absent in entries written before dedup
+    if (!parseNumber(flags, encrypted) || (hasMore(flags) && !parseNumber(flags, codec)) ||
+        (hasMore(flags) && !parseNumber(flags, chunkCount)) || chunkCount > data.size()) {
+        return Entry();
+    }
+    entry.encrypted = encrypted != 0;
+    entry.codec = static_cast<std::uint8_t>(codec);
+    entry.chunks.resize(chunkCount);
+    for (auto& chunk : entry.chunks) {
+        chunk.assign(nextLine(data));
+    }
+    entry.content.assign(data.substr(0, data.find('\0'))); // Read until the end
     
     return entry;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,142 @@
+#include "../include/IndexSnapshot.hpp"
+#include "../include/Encryption.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[] = "DIARYIDX";
+
+// Header: "DIARYIDX <version> <generation> <times> <tags> <crc32>\n", followed
+// by the encrypted body. The checksum covers the plaintext body, so a wrong
+// key is caught the same way as a damaged file.
+// Body: one "<timestamp> <id>" line per entry, then for every tag string a
+// "<count> <tags>" line and a line with its ids.
+
+template <typename T>
+bool parseNumber(const char*& cursor, const char* end, T& value) {
+    auto result = std::from_chars(cursor, end, value);
+    if (result.ec != std::errc() || result.ptr == end || (*result.ptr != ' ' && *result.ptr != '\n')) {
+        return false;
+    }
+    cursor = result.ptr + 1;
+    return true;
+}
+
+} // namespace
+
+bool IndexSnapshot::save(const std::string& path, std::string_view key, std::uint64_t generation,
+                         const TimeIndex& timeIndex, const TagIndex& tagIndex) {
+    std::string body;
+    char line[64];
+    for (const auto& item : timeIndex) {
+        int n = std::snprintf(line, sizeof(line), "%lld %llu\n", static_cast<long long>(item.first),
+                              static_cast<unsigned long long>(item.second));
+        body.append(line, n);
+    }
+    for (const auto& tag : tagIndex) {
+        body += std::to_string(tag.second.size()) + " " + tag.first + "\n";
+        for (std::uint64_t id : tag.second) {
+            body += std::to_string(id) + " ";
+        }
+        body += "\n";
+    }
+
+    std::ostringstream header;
+    header << kMagic << " " << Version << " " << generation << " " << timeIndex.size() << " "
+           << tagIndex.size() << " " << Encryption::crc32(body.data(), body.size()) << "\n";
+
+    // Written aside and renamed, so a reader never sees half a snapshot
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << header.str() << Encryption::encrypt(body, key);
+        if (!file) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+bool IndexSnapshot::load(const std::string& path, std::string_view key, std::uint64_t generation,
+                         TimeIndex& timeIndex, TagIndex& tagIndex) {
+    std::ifstream file(path, std::ios::binary);
+    std::string headerLine;
+    if (!file || !std::getline(file, headerLine)) {
+        return false;
+    }
+
+    // Cheap checks first: nothing is decrypted for a stale snapshot
+    std::istringstream header(headerLine);
+    std::string magic;
+    std::uint32_t version = 0;
+    std::uint64_t snapshotGeneration = 0;
+    size_t timeCount = 0;
+    size_t tagCount = 0;
+    std::uint32_t crc = 0;
+    if (!(header >> magic >> version >> snapshotGeneration >> timeCount >> tagCount >> crc) ||
+        magic != kMagic || version != Version || snapshotGeneration != generation) {
+        return false;
+    }
+
+    std::stringstream encrypted;
+    encrypted << file.rdbuf();
+    SecureString body = Encryption::decrypt(encrypted.str(), key);
+    if (Encryption::crc32(body.data(), body.size()) != crc) {
+        return false;
+    }
+
+    TimeIndex times;
+    TagIndex tags;
+    const char* cursor = body.data();
+    const char* end = body.data() + body.size();
+    for (size_t i = 0; i < timeCount; ++i) {
+        long long timestamp = 0;
+        std::uint64_t id = 0;
+        if (!parseNumber(cursor, end, timestamp) || !parseNumber(cursor, end, id)) {
+            return false;
+        }
+        times.emplace_hint(times.end(), static_cast<std::time_t>(timestamp), id);
+    }
+    for (size_t i = 0; i < tagCount; ++i) {
+        size_t idCount = 0;
+        if (!parseNumber(cursor, end, idCount)) {
+            return false;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if (!newline) {
+            return false;
+        }
+        std::set<std::uint64_t>& ids = tags[std::string(cursor, newline)];
+        cursor = newline + 1;
+        for (size_t j = 0; j < idCount; ++j) {
+            std::uint64_t id = 0;
+            if (!parseNumber(cursor, end, id)) {
+                return false;
+            }
+            ids.emplace_hint(ids.end(), id);
+        }
+        if (cursor == end || *cursor != '\n') {
+            return false;
+        }
+        ++cursor;
+    }
+    if (cursor != end) {
+        return false;
+    }
+
+    timeIndex.swap(times);
+    tagIndex.swap(tags);
+    return true;
+}
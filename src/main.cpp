@@ -1,10 +1,17 @@
 #include <iostream>
+#include <cstdio>
 #include <string>
 #include <limits>
 #include <ctime>
 #include "../include/Diary.hpp"
 #include "../include/Entry.hpp"
 #include "../include/User.hpp"
+#include "../include/DateFormatter.hpp"
+#ifdef DIARY_HAVE_DAEMON
+#include <csignal>
+#include "../include/DiaryClient.hpp"
+#include "../include/DiaryServer.hpp"
+#endif
 
 void clearScreen() {
     #ifdef _WIN32
@@ -36,6 +43,21 @@ void displaySearchMenu() {
               << "Choose an option: ";
 }
 
+const size_t kPageSize = 20;
+
+void formatEntry(const Entry& entry, std::string& output) {
+    output += "\nTitle: ";
+    output += entry.getTitle();
+    output += "\nDate: ";
+    char date[DateFormatter::BufferSize];
+    output.append(date, entry.formatDate(date, sizeof(date)));
+    output += "\nTags: ";
+    output += entry.getTags();
+    output += "\nContent: ";
+    output += entry.getContent();
+    output += "\n------------------------\n";
+}
+
 std::string getInput(const std::string& prompt) {
     std::string input;
     std::cout << prompt;
@@ -43,8 +65,9 @@ std::string getInput(const std::string& prompt) {
     return input;
 }
 
-int main() {
-    Diary diary("./data");
+// Runs the interactive menus against a local Diary or a DiaryClient
+template <typename DiaryBackend>
+void runSession(DiaryBackend& diary) {
     bool running = true;
     bool loggedIn = false;
     std::string username, password;
@@ -117,17 +140,28 @@ int main() {
                 break;
             }
             case 2: { // View All Entries
-                auto entries = diary.getAllEntries();
-                if (entries.empty()) {
-                    std::cout << "No entries found.\n";
-                } else {
-                    for (const auto& entry : entries) {
-                        std::cout << "\nTitle: " << entry.getTitle() << "\n"
-                                << "Date: " << entry.getFormattedDate() << "\n"
-                                << "Tags: " << entry.getTags() << "\n"
-                                << "Content: " << entry.getContent() << "\n"
-                                << "------------------------\n";
+                // One page at a time, oldest first, rendered into a reused
+                // buffer and written with a single call
+                EntryCursor cursor;
+                std::vector<Entry> page;
+                std::string output;
+                bool found = false;
+                while (diary.nextPage(cursor, kPageSize, page)) {
+                    found = true;
+                    output.clear();
+                    for (const auto& entry : page) {
+                        formatEntry(entry, output);
                     }
+                    std::fwrite(output.data(), 1, output.size(), stdout);
+                    std::fflush(stdout);
+                    
+                    if (page.size() < kPageSize ||
+                        getInput("-- Press Enter for more, or q to stop: ") == "q") {
+                        break;
+                    }
+                }
+                if (!found) {
+                    std::cout << "No entries found.\n";
                 }
                 break;
             }
@@ -162,12 +196,19 @@ int main() {
                 }
 
                 if (!results.empty()) {
+                    std::string output;
+                    char date[DateFormatter::BufferSize];
                     for (const auto& entry : results) {
-                        std::cout << "\nTitle: " << entry.getTitle() << "\n"
-                                << "Date: " << entry.getFormattedDate() << "\n"
-                                << "Content: " << entry.getContent() << "\n"
-                                << "------------------------\n";
+                        output += "\nTitle: ";
+                        output += entry.getTitle();
+                        output += "\nDate: ";
+                        output.append(date, entry.formatDate(date, sizeof(date)));
+                        output += "\nContent: ";
+                        output += entry.getContent();
+                        output += "\n------------------------\n";
                     }
+                    std::fwrite(output.data(), 1, output.size(), stdout);
+                    std::fflush(stdout);
                 } else {
                     std::cout << "No entries found.\n";
                 }
@@ -230,7 +271,53 @@ int main() {
         std::cout << "\nPress Enter to continue...";
         std::cin.get();
     }
+}
+
+#ifdef DIARY_HAVE_DAEMON
+DiaryServer* activeServer = nullptr;
 
+void handleStopSignal(int) {
+    if (activeServer) {
+        activeServer->stop();
+    }
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    const std::string storageDir = "./data";
+    
+#ifdef DIARY_HAVE_DAEMON
+    const std::string socketPath = storageDir + "/diary.sock";
+    if (argc > 1 && std::string(argv[1]) == "--daemon") {
+        // Keep the diary warm in memory and serve clients until signalled
+        Diary diary(storageDir);
+        DiaryServer server(diary, socketPath);
+        if (!server.start()) {
+            std::cerr << "Failed to listen on " << socketPath << "\n";
+            return 1;
+        }
+        activeServer = &server;
+        std::signal(SIGINT, handleStopSignal);
+        std::signal(SIGTERM, handleStopSignal);
+        server.run();
+        diary.logoutUser();
+        return 0;
+    }
+    
+    // Use a running daemon when there is one, otherwise load the diary here
+    DiaryClient client;
+    if (client.connect(socketPath)) {
+        runSession(client);
+        std::cout << "Thank you for using Personal Diary!\n";
+        return 0;
+    }
+#else
+    (void)argc;
+    (void)argv;
+#endif
+    
+    Diary diary(storageDir);
+    runSession(diary);
     std::cout << "Thank you for using Personal Diary!\n";
     return 0;
 } 
\ No newline at end of file
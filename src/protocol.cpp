@@ -0,0 +1,128 @@
+#include "../include/Protocol.hpp"
+
+Protocol::Reader::Reader(const std::string& data) : data(data), pos(0) {}
+
+bool Protocol::Reader::readU32(std::uint32_t& value) {
+    std::uint64_t wide = 0;
+    if (data.size() - pos < 4) {
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        wide |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[pos++])) << (8 * i);
+    }
+    value = static_cast<std::uint32_t>(wide);
+    return true;
+}
+
+bool Protocol::Reader::readU64(std::uint64_t& value) {
+    if (data.size() - pos < 8) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[pos++])) << (8 * i);
+    }
+    return true;
+}
+
+bool Protocol::Reader::readString(std::string& value) {
+    std::uint32_t length;
+    if (!readU32(length) || data.size() - pos < length) {
+        return false;
+    }
+    value.assign(data, pos, length);
+    pos += length;
+    return true;
+}
+
+bool Protocol::Reader::readEntry(Entry& entry) {
+    std::uint64_t id;
+    std::string serialized;
+    if (!readU64(id) || !readString(serialized)) {
+        return false;
+    }
+    entry = Entry::deserialize(serialized);
+    entry.setId(id);
+    return true;
+}
+
+bool Protocol::Reader::readEntries(std::vector<Entry>& entries) {
+    std::uint32_t count;
+    if (!readU32(count)) {
+        return false;
+    }
+    entries.resize(count <= data.size() - pos ? count : 0);
+    for (auto& entry : entries) {
+        if (!readEntry(entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Protocol::appendFrame(std::string& out, std::uint8_t code, std::uint32_t requestId,
+                           const std::string& body) {
+    writeU32(out, static_cast<std::uint32_t>(body.size()));
+    out += static_cast<char>(code);
+    writeU32(out, requestId);
+    out += body;
+}
+
+bool Protocol::extractFrame(const std::string& in, size_t& offset, Frame& frame, bool& malformed) {
+    malformed = false;
+    if (in.size() - offset < HeaderSize) {
+        return false;
+    }
+
+    auto readHeaderU32 = [&](size_t at) {
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<std::uint32_t>(static_cast<unsigned char>(in[offset + at + i])) << (8 * i);
+        }
+        return value;
+    };
+
+    std::uint32_t length = readHeaderU32(0);
+    if (length > MaxBodySize) {
+        malformed = true;
+        return false;
+    }
+    if (in.size() - offset - HeaderSize < length) {
+        return false;
+    }
+
+    frame.code = static_cast<std::uint8_t>(in[offset + 4]);
+    frame.requestId = readHeaderU32(5);
+    frame.body.assign(in, offset + HeaderSize, length);
+    offset += HeaderSize + length;
+    return true;
+}
+
+void Protocol::writeU32(std::string& out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void Protocol::writeU64(std::string& out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void Protocol::writeString(std::string& out, const std::string& value) {
+    writeU32(out, static_cast<std::uint32_t>(value.size()));
+    out += value;
+}
+
+void Protocol::writeEntry(std::string& out, const Entry& entry) {
+    writeU64(out, entry.getId());
+    writeString(out, entry.serialize());
+}
+
+void Protocol::writeEntries(std::string& out, const std::vector<Entry>& entries) {
+    writeU32(out, static_cast<std::uint32_t>(entries.size()));
+    for (const auto& entry : entries) {
+        writeEntry(out, entry);
+    }
+}
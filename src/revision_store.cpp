@@ -0,0 +1,378 @@
+#include "../include/RevisionStore.hpp"
+#include "../include/Compression.hpp"
+#include "../include/Encryption.hpp"
+#include "../include/SecureMemory.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+
+namespace {
+
+// Target positions are matched against base blocks of this size; shorter
+// common runs are cheaper to insert than to reference
+const size_t kDeltaBlock = 16;
+
+// Bound on a revision header: six integers of at most 20 characters each,
+// their separators and the newline
+const size_t kMaxHeaderBytes = 128;
+
+void putVarint(SecureString& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool getVarint(std::string_view& in, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(in.front());
+        in.remove_prefix(1);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t hashBlock(const char* data) {
+    std::uint64_t a;
+    std::uint64_t b;
+    std::memcpy(&a, data, sizeof(a));
+    std::memcpy(&b, data + sizeof(a), sizeof(b));
+    std::uint64_t z = a ^ (b * 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Ops are a varint of (length << 1 | copy), followed by the base offset for
+// a copy or the literal bytes for an insert
+void putInsert(SecureString& out, std::string_view literal) {
+    if (!literal.empty()) {
+        putVarint(out, literal.size() << 1);
+        out.append(literal.data(), literal.size());
+    }
+}
+
+void putCopy(SecureString& out, size_t offset, size_t length) {
+    putVarint(out, length << 1 | 1);
+    putVarint(out, offset);
+}
+
+// Revision record payload: "<entry id> <number> <keyframe> <codec> <timestamp> <size>\n<encrypted body>"
+bool parseRevisionHeader(const std::string& payload, std::uint64_t& entryId, RevisionStore::Revision& revision,
+                         int& codec, size_t& bodyOffset) {
+    size_t newline = payload.find('\n');
+    if (newline == std::string::npos) {
+        return false;
+    }
+    std::istringstream header(payload.substr(0, newline));
+    long long timestamp = 0;
+    int keyframe = 0;
+    if (!(header >> entryId >> revision.number >> keyframe >> codec >> timestamp >> revision.size)) {
+        return false;
+    }
+    revision.keyframe = keyframe != 0;
+    revision.timestamp = static_cast<std::time_t>(timestamp);
+    bodyOffset = newline + 1;
+    return true;
+}
+
+} // namespace
+
+RevisionStore::RevisionStore(const std::string& directory, const Compression::Dictionaries& dictionaries)
+    : store(directory), dictionaries(dictionaries) {}
+
+bool RevisionStore::open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!store.open()) {
+        return false;
+    }
+
+    // Only the headers are read here; bodies are fetched by read()
+    histories.clear();
+    std::string head;
+    for (std::uint64_t id : store.getIds()) {
+        std::uint64_t entryId = 0;
+        Revision revision{};
+        int codec = 0;
+        size_t bodyOffset = 0;
+        size_t length = 0;
+        if (!store.getPrefix(id, kMaxHeaderBytes, head, length) ||
+            !parseRevisionHeader(head, entryId, revision, codec, bodyOffset)) {
+            store.remove(id); // Unreadable, left by an interrupted write
+            continue;
+        }
+        revision.storedBytes = static_cast<std::uint32_t>(length - bodyOffset);
+        histories[entryId].push_back({id, revision});
+    }
+
+    // Record ids grow with every append, so they also order each history;
+    // numbering must be contiguous or later deltas have no base
+    for (auto it = histories.begin(); it != histories.end();) {
+        std::vector<Record>& history = it->second;
+        std::sort(history.begin(), history.end(),
+                  [](const Record& a, const Record& b) { return a.recordId < b.recordId; });
+        size_t valid = 0;
+        while (valid < history.size() && history[valid].revision.number == valid + 1) {
+            ++valid;
+        }
+        for (size_t i = valid; i < history.size(); ++i) {
+            store.remove(history[i].recordId);
+        }
+        history.resize(valid);
+        it = history.empty() ? histories.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+void RevisionStore::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    store.close();
+    histories.clear();
+}
+
+void RevisionStore::startCompactor() {
+    store.startCompactor();
+}
+
+bool RevisionStore::append(std::uint64_t entryId, const Entry& version, std::string_view key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Record>& history = histories[entryId];
+    std::string text = version.serialize();
+
+    Revision revision{};
+    revision.number = static_cast<std::uint32_t>(history.size() + 1);
+    revision.timestamp = version.getTimestamp();
+    revision.size = static_cast<std::uint32_t>(text.size());
+
+    // A keyframe once the chain since the last one is full, or when the
+    // delta would not be smaller than the version itself
+    size_t chainLength = 0;
+    while (chainLength < history.size() && !history[history.size() - 1 - chainLength].revision.keyframe) {
+        ++chainLength;
+    }
+    SecureString body;
+    revision.keyframe = history.empty() || chainLength + 1 >= KeyframeInterval;
+    if (!revision.keyframe) {
+        // An unreadable previous revision cannot be a base either
+        SecureString previous;
+        if (readLocked(history, revision.number - 1, key, previous)) {
+            body = makeDelta(previous, text);
+        }
+        if (body.empty() || body.size() >= text.size()) {
+            revision.keyframe = true;
+        }
+    }
+    if (revision.keyframe) {
+        body.assign(text.data(), text.size());
+    }
+    scrub(text);
+
+    SecureString compressed;
+    Compression::Codec codec = Compression::compress(body, Compression::getDefaultCodec(), compressed, &dictionaries);
+    std::string sealed = Encryption::encrypt(codec == Compression::None ? body : compressed, key);
+    std::string payload = std::to_string(entryId) + " " + std::to_string(revision.number) + " " +
+                          (revision.keyframe ? "1" : "0") + " " + std::to_string(static_cast<int>(codec)) + " " +
+                          std::to_string(static_cast<long long>(revision.timestamp)) + " " +
+                          std::to_string(revision.size) + "\n" + sealed;
+    revision.storedBytes = static_cast<std::uint32_t>(sealed.size());
+
+    std::uint64_t recordId = store.allocateId();
+    if (!store.put(recordId, payload) || !store.sync()) {
+        return false;
+    }
+    history.push_back({recordId, revision});
+    return true;
+}
+
+std::vector<RevisionStore::Revision> RevisionStore::list(std::uint64_t entryId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Revision> revisions;
+    auto it = histories.find(entryId);
+    if (it != histories.end()) {
+        for (const auto& record : it->second) {
+            revisions.push_back(record.revision);
+        }
+    }
+    return revisions;
+}
+
+bool RevisionStore::read(std::uint64_t entryId, std::uint32_t number, std::string_view key,
+                         Entry& version) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = histories.find(entryId);
+    SecureString text;
+    if (it == histories.end() || !readLocked(it->second, number, key, text)) {
+        return false;
+    }
+    version = Entry::deserialize(text);
+    version.setId(entryId);
+    return true;
+}
+
+bool RevisionStore::remove(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = histories.find(entryId);
+    if (it == histories.end()) {
+        return true;
+    }
+    // Newest first: an interrupted removal leaves a readable prefix
+    for (auto record = it->second.rbegin(); record != it->second.rend(); ++record) {
+        if (!store.remove(record->recordId)) {
+            return false;
+        }
+    }
+    histories.erase(it);
+    return store.sync();
+}
+
+std::uint64_t RevisionStore::getStoredBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint64_t total = 0;
+    for (const auto& history : histories) {
+        for (const auto& record : history.second) {
+            total += record.revision.storedBytes;
+        }
+    }
+    return total;
+}
+
+std::uint64_t RevisionStore::getVersionBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint64_t total = 0;
+    for (const auto& history : histories) {
+        for (const auto& record : history.second) {
+            total += record.revision.size;
+        }
+    }
+    return total;
+}
+
+SecureString RevisionStore::makeDelta(std::string_view base, std::string_view target) {
+    SecureString delta;
+    putVarint(delta, target.size());
+
+    // First occurrence of each aligned base block
+    std::unordered_map<std::uint64_t, size_t> blocks;
+    blocks.reserve(base.size() / kDeltaBlock);
+    for (size_t offset = 0; offset + kDeltaBlock <= base.size(); offset += kDeltaBlock) {
+        blocks.emplace(hashBlock(base.data() + offset), offset);
+    }
+
+    size_t literalStart = 0;
+    size_t position = 0;
+    while (position + kDeltaBlock <= target.size()) {
+        auto match = blocks.find(hashBlock(target.data() + position));
+        if (match == blocks.end() ||
+            std::memcmp(base.data() + match->second, target.data() + position, kDeltaBlock) != 0) {
+            ++position;
+            continue;
+        }
+
+        // Grow the match backwards into the pending literal, then forwards
+        size_t baseStart = match->second;
+        size_t targetStart = position;
+        while (targetStart > literalStart && baseStart > 0 && base[baseStart - 1] == target[targetStart - 1]) {
+            --baseStart;
+            --targetStart;
+        }
+        size_t baseEnd = match->second + kDeltaBlock;
+        size_t targetEnd = position + kDeltaBlock;
+        while (targetEnd < target.size() && baseEnd < base.size() && base[baseEnd] == target[targetEnd]) {
+            ++baseEnd;
+            ++targetEnd;
+        }
+
+        putInsert(delta, target.substr(literalStart, targetStart - literalStart));
+        putCopy(delta, baseStart, targetEnd - targetStart);
+        position = literalStart = targetEnd;
+    }
+    putInsert(delta, target.substr(literalStart));
+    return delta;
+}
+
+bool RevisionStore::applyDelta(std::string_view base, std::string_view delta, SecureString& target) {
+    std::uint64_t size = 0;
+    if (!getVarint(delta, size)) {
+        return false;
+    }
+    target.clear();
+    target.reserve(size);
+    while (!delta.empty()) {
+        std::uint64_t op = 0;
+        if (!getVarint(delta, op)) {
+            return false;
+        }
+        std::uint64_t length = op >> 1;
+        if (op & 1) {
+            std::uint64_t offset = 0;
+            if (!getVarint(delta, offset) || offset > base.size() || length > base.size() - offset) {
+                return false;
+            }
+            target.append(base.data() + offset, length);
+        } else {
+            if (length > delta.size()) {
+                return false;
+            }
+            target.append(delta.data(), length);
+            delta.remove_prefix(length);
+        }
+        if (target.size() > size) {
+            return false;
+        }
+    }
+    return target.size() == size;
+}
+
+bool RevisionStore::readLocked(const std::vector<Record>& history, std::uint32_t number, std::string_view key,
+                               SecureString& version) const {
+    if (number == 0 || number > history.size()) {
+        return false;
+    }
+
+    // Start from the nearest keyframe at or before the revision
+    size_t first = number - 1;
+    while (!history[first].revision.keyframe) {
+        if (first == 0) {
+            return false;
+        }
+        --first;
+    }
+
+    std::string payload;
+    SecureString body;
+    SecureString next;
+    version.clear();
+    for (size_t i = first; i < number; ++i) {
+        std::uint64_t entryId = 0;
+        Revision revision{};
+        int codec = 0;
+        size_t bodyOffset = 0;
+        if (!store.get(history[i].recordId, payload) ||
+            !parseRevisionHeader(payload, entryId, revision, codec, bodyOffset) ||
+            !Compression::decompress(Encryption::decrypt(std::string_view(payload).substr(bodyOffset), key),
+                                     static_cast<Compression::Codec>(codec), body, &dictionaries)) {
+            version.clear();
+            return false;
+        }
+        if (revision.keyframe) {
+            version.swap(body);
+        } else {
+            if (!applyDelta(version, body, next)) {
+                version.clear();
+                return false;
+            }
+            version.swap(next);
+        }
+        if (version.size() != revision.size) {
+            version.clear();
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,240 @@
+#include "../include/SecureMemory.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+size_t pageSize() {
+#ifdef _WIN32
+    return 4096;
+#else
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+#endif
+}
+
+size_t roundToPages(size_t bytes) {
+    size_t page = pageSize();
+    return (bytes + page - 1) / page * page;
+}
+
+#ifndef _WIN32
+// Maps `usable` bytes between two inaccessible guard pages. Locking is best
+// effort: without enough RLIMIT_MEMLOCK the memory is still usable, just
+// swappable. Returns the start of the whole mapping, or nullptr.
+char* mapGuarded(size_t usable, bool& locked) {
+    size_t page = pageSize();
+    void* mapping = mmap(nullptr, usable + 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    char* start = static_cast<char*>(mapping);
+    mprotect(start, page, PROT_NONE);
+    mprotect(start + page + usable, page, PROT_NONE);
+#ifdef MADV_DONTDUMP
+    madvise(start + page, usable, MADV_DONTDUMP);
+#endif
+    locked = mlock(start + page, usable) == 0;
+    return start;
+}
+
+void unmapGuarded(char* mapping, size_t usable, bool locked) {
+    size_t page = pageSize();
+    secureZero(mapping + page, usable);
+    if (locked) {
+        munlock(mapping + page, usable);
+    }
+    munmap(mapping, usable + 2 * page);
+}
+#endif
+
+} // namespace
+
+void secureZero(void* data, size_t length) {
+    if (data == nullptr || length == 0) {
+        return;
+    }
+#if defined(__GLIBC__) || defined(__OpenBSD__) || defined(__FreeBSD__)
+    explicit_bzero(data, length);
+#else
+    volatile unsigned char* bytes = static_cast<volatile unsigned char*>(data);
+    while (length-- > 0) {
+        *bytes++ = 0;
+    }
+#endif
+}
+
+void scrub(std::string& text) {
+    if (text.capacity() > 0) {
+        secureZero(&text[0], text.capacity());
+    }
+    text.clear();
+}
+
+SecurePool& SecurePool::instance() {
+    // Never destroyed: strings with static storage may release into it at exit
+    static SecurePool* pool = new SecurePool();
+    return *pool;
+}
+
+#ifdef _WIN32
+
+// No page locking or guard pages here; blocks are still zeroed on release
+void* SecurePool::allocate(size_t bytes) {
+    return ::operator new(bytes);
+}
+
+void SecurePool::deallocate(void* pointer, size_t bytes) {
+    secureZero(pointer, bytes);
+    ::operator delete(pointer);
+}
+
+void SecurePool::wipe() {}
+
+SecurePool::Stats SecurePool::getStats() {
+    return {0, 0, 0};
+}
+
+#else
+
+void* SecurePool::allocate(size_t bytes) {
+    size_t classIndex = classOf(bytes);
+    if (classIndex == ClassCount) {
+        size_t usable = roundToPages(bytes);
+        bool locked = false;
+        char* mapping = mapGuarded(usable, locked);
+        if (mapping == nullptr) {
+            throw std::bad_alloc();
+        }
+        largeBytes += usable;
+        liveBytes += usable;
+        return mapping + pageSize();
+    }
+
+    size_t blockSize = size_t(1) << (MinClassShift + classIndex);
+    SizeClass& sizeClass = classes[classIndex];
+    char* block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        if (!sizeClass.freeList.empty()) {
+            block = sizeClass.freeList.back();
+            sizeClass.freeList.pop_back();
+            ++findArena(sizeClass, block)->live;
+        } else {
+            // Bump-allocate from the current arena, opening another when it is full
+            Arena* arena = sizeClass.current;
+            if (arena == nullptr || arena->size - arena->used < blockSize) {
+                if (!addArena(sizeClass)) {
+                    throw std::bad_alloc();
+                }
+                arena = sizeClass.current;
+            }
+            block = arena->base + arena->used;
+            arena->used += blockSize;
+            ++arena->live;
+        }
+    }
+    liveBytes += blockSize;
+    return block;
+}
+
+void SecurePool::deallocate(void* pointer, size_t bytes) {
+    if (pointer == nullptr) {
+        return;
+    }
+
+    size_t classIndex = classOf(bytes);
+    char* block = static_cast<char*>(pointer);
+    if (classIndex == ClassCount) {
+        size_t usable = roundToPages(bytes);
+        // The lock state of a large mapping is not tracked; munlock on
+        // unlocked pages is harmless
+        unmapGuarded(block - pageSize(), usable, true);
+        largeBytes -= usable;
+        liveBytes -= usable;
+        return;
+    }
+
+    size_t blockSize = size_t(1) << (MinClassShift + classIndex);
+    SizeClass& sizeClass = classes[classIndex];
+    secureZero(block, blockSize);
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        --findArena(sizeClass, block)->live;
+        sizeClass.freeList.push_back(block);
+    }
+    liveBytes -= blockSize;
+}
+
+void SecurePool::wipe() {
+    for (SizeClass& sizeClass : classes) {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        // Free blocks inside released arenas must not be handed out again
+        std::vector<char*>& freeList = sizeClass.freeList;
+        freeList.erase(std::remove_if(freeList.begin(), freeList.end(),
+                                      [&sizeClass](char* block) { return findArena(sizeClass, block)->live == 0; }),
+                       freeList.end());
+        for (auto it = sizeClass.arenas.begin(); it != sizeClass.arenas.end();) {
+            Arena& arena = it->second;
+            if (arena.live != 0) {
+                ++it;
+                continue;
+            }
+            if (&arena == sizeClass.current) {
+                sizeClass.current = nullptr;
+            }
+            unmapGuarded(arena.mapping, arena.size, arena.locked);
+            it = sizeClass.arenas.erase(it);
+        }
+    }
+}
+
+SecurePool::Stats SecurePool::getStats() {
+    Stats stats = {largeBytes.load(), 0, 0};
+    for (SizeClass& sizeClass : classes) {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        for (const auto& arena : sizeClass.arenas) {
+            stats.mappedBytes += arena.second.size;
+            stats.lockedBytes += arena.second.locked ? arena.second.size : 0;
+        }
+    }
+    stats.liveBytes = liveBytes.load();
+    return stats;
+}
+
+size_t SecurePool::classOf(size_t bytes) {
+    size_t classIndex = 0;
+    while (classIndex < ClassCount && (size_t(1) << (MinClassShift + classIndex)) < bytes) {
+        ++classIndex;
+    }
+    return classIndex;
+}
+
+SecurePool::Arena* SecurePool::findArena(SizeClass& sizeClass, const char* pointer) {
+    auto it = sizeClass.arenas.upper_bound(pointer);
+    if (it == sizeClass.arenas.begin()) {
+        return nullptr;
+    }
+    --it;
+    Arena& arena = it->second;
+    return pointer < arena.base + arena.size ? &arena : nullptr;
+}
+
+bool SecurePool::addArena(SizeClass& sizeClass) {
+    bool locked = false;
+    char* mapping = mapGuarded(ArenaSize, locked);
+    if (mapping == nullptr) {
+        return false;
+    }
+    char* base = mapping + pageSize();
+    sizeClass.current = &sizeClass.arenas.emplace(base, Arena{mapping, base, ArenaSize, 0, 0, locked}).first->second;
+    return true;
+}
+
+#endif
@@ -0,0 +1,898 @@
+#include "../include/SegmentStore.hpp"
+#include "../include/Encryption.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::uint64_t kDefaultMaxSegmentSize = 4 * 1024 * 1024;
+const std::uint64_t kDefaultIoRateLimit = 8 * 1024 * 1024;
+const double kDefaultCompactionThreshold = 0.5;
+const size_t kCompactionBlockSize = 64 * 1024;
+const std::uint64_t kScanBufferSize = 1024 * 1024;
+const size_t kScanBuffers = 2; // One being read while the other is visited
+const std::uint64_t kMaxReadGap = 64 * 1024; // Unwanted bytes read to save a separate pread
+
+// Record layout: "<op> <id> <sequence> <length> <crc32>\n<payload>\n"
+// op is 'P' (put), 'D' (delete) or 'S' (sequence checkpoint). A checkpoint's
+// id is the next record id, so ids stay unique after compaction drops the
+// records that used them.
+struct RecordHeader {
+    char op;
+    std::uint64_t id;
+    std::uint64_t sequence;
+    std::uint32_t length;
+    std::uint32_t crc;
+    std::uint32_t headerBytes;
+};
+
+bool parseField(const char*& cursor, const char* end, std::uint64_t& value) {
+    auto result = std::from_chars(cursor, end, value);
+    if (result.ec != std::errc() || result.ptr == end) {
+        return false;
+    }
+    cursor = result.ptr + 1; // Skip separator
+    return true;
+}
+
+// Returns false if the record at `offset` is truncated, malformed or fails its checksum.
+bool parseRecord(const std::string& data, size_t offset, RecordHeader& header) {
+    size_t newline = data.find('\n', offset);
+    if (newline == std::string::npos || newline - offset < 2 || data[offset + 1] != ' ') {
+        return false;
+    }
+
+    const char* cursor = data.data() + offset + 2;
+    const char* end = data.data() + newline + 1;
+    std::uint64_t length = 0;
+    std::uint64_t crc = 0;
+    header.op = data[offset];
+    if (!parseField(cursor, end, header.id) || !parseField(cursor, end, header.sequence) ||
+        !parseField(cursor, end, length) || !parseField(cursor, end, crc) || cursor != end) {
+        return false;
+    }
+    if (header.op != 'P' && header.op != 'D' && header.op != 'S') {
+        return false;
+    }
+
+    header.length = static_cast<std::uint32_t>(length);
+    header.crc = static_cast<std::uint32_t>(crc);
+    header.headerBytes = static_cast<std::uint32_t>(newline + 1 - offset);
+
+    size_t payloadStart = newline + 1;
+    if (payloadStart + length + 1 > data.size() || data[payloadStart + length] != '\n') {
+        return false;
+    }
+    return Encryption::crc32(data.data() + payloadStart, length) == header.crc;
+}
+
+std::string formatHeader(char op, std::uint64_t id, std::uint64_t sequence, const std::string& payload) {
+    char header[96];
+    int n = std::snprintf(header, sizeof(header), "%c %llu %llu %zu %u\n", op,
+                          static_cast<unsigned long long>(id),
+                          static_cast<unsigned long long>(sequence),
+                          payload.size(),
+                          static_cast<unsigned>(Encryption::crc32(payload.data(), payload.size())));
+    return std::string(header, n);
+}
+
+bool readWholeFile(const std::string& path, std::string& out) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    out.clear();
+    char buffer[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        out.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return n == 0;
+}
+
+bool readAt(int fd, char* data, size_t length, std::uint64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pread(fd, data + done, length - done, static_cast<off_t>(offset + done));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Writes header, payload and the trailing newline with one gathered write,
+// without first copying the payload into a record buffer
+bool writeRecord(int fd, const std::string& header, const std::string& payload) {
+    char newline = '\n';
+    iovec parts[3] = {{const_cast<char*>(header.data()), header.size()},
+                      {const_cast<char*>(payload.data()), payload.size()},
+                      {&newline, 1}};
+    iovec* part = parts;
+    int remaining = 3;
+    while (remaining > 0) {
+        ssize_t n = ::writev(fd, part, remaining);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size_t written = static_cast<size_t>(n);
+        while (remaining > 0 && written >= part->iov_len) {
+            written -= part->iov_len;
+            ++part;
+            --remaining;
+        }
+        if (remaining > 0) {
+            part->iov_base = static_cast<char*>(part->iov_base) + written;
+            part->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+void syncDirectory(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+std::uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+SegmentStore::SegmentStore(const std::string& directory)
+    : directory(directory), activeSegment(0), activeFd(-1), lockFd(-1), nextRecordId(1), sequence(0),
+      compactionThreshold(kDefaultCompactionThreshold), ioRateLimit(kDefaultIoRateLimit),
+      maxSegmentSize(kDefaultMaxSegmentSize), compactorRunning(false) {}
+
+SegmentStore::~SegmentStore() {
+    close();
+}
+
+bool SegmentStore::open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (activeFd >= 0) {
+        return true;
+    }
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+
+    // Another process appending or compacting with its own index would
+    // corrupt the files; a second client must go through the daemon
+    if (lockFd < 0) {
+        lockFd = ::open((directory + "/LOCK").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (lockFd < 0) {
+            return false;
+        }
+        if (::flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(lockFd);
+            lockFd = -1;
+            return false;
+        }
+    }
+
+    index.clear();
+    segments.clear();
+    nextRecordId = 1;
+    sequence = 0;
+
+    std::vector<std::uint32_t> ids;
+    for (const auto& file : fs::directory_iterator(directory, ec)) {
+        std::string name = file.path().filename().string();
+        unsigned id = 0;
+        char suffix[16] = {0};
+        if (std::sscanf(name.c_str(), "segment-%u.%15s", &id, suffix) != 2) {
+            continue;
+        }
+        if (std::string(suffix) == "compact") {
+            fs::remove(file.path(), ec); // Interrupted compaction, original is intact
+        } else if (std::string(suffix) == "dat") {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    for (std::uint32_t id : ids) {
+        if (!replaySegment(id, id == ids.back())) {
+            unlock();
+            return false;
+        }
+    }
+
+    if (!openSegment(ids.empty() ? 1 : ids.back())) {
+        unlock();
+        return false;
+    }
+    return true;
+}
+
+void SegmentStore::close() {
+    stopCompactor();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (activeFd >= 0) {
+        ::fdatasync(activeFd);
+        ::close(activeFd);
+        activeFd = -1;
+    }
+    unlock();
+    index.clear();
+    segments.clear();
+}
+
+bool SegmentStore::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return activeFd >= 0;
+}
+
+bool SegmentStore::sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return activeFd < 0 || ::fdatasync(activeFd) == 0;
+}
+
+std::uint64_t SegmentStore::allocateId() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextRecordId++;
+}
+
+bool SegmentStore::put(std::uint64_t id, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (activeFd < 0) {
+        return false;
+    }
+
+    Location location;
+    if (!appendRecord('P', id, payload, location)) {
+        return false;
+    }
+
+    auto it = index.find(id);
+    if (it != index.end()) {
+        markDead(it->second);
+        it->second = location;
+    } else {
+        index.emplace(id, location);
+    }
+    nextRecordId = std::max(nextRecordId, id + 1);
+    return true;
+}
+
+bool SegmentStore::remove(std::uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(id);
+    if (activeFd < 0 || it == index.end()) {
+        return false;
+    }
+
+    Location tombstone;
+    if (!appendRecord('D', id, std::string(), tombstone)) {
+        return false;
+    }
+    markDead(it->second);
+    index.erase(it);
+    return true;
+}
+
+bool SegmentStore::get(std::uint64_t id, std::string& payload) const {
+    size_t length = 0;
+    return getPrefix(id, std::numeric_limits<size_t>::max(), payload, length);
+}
+
+bool SegmentStore::getPrefix(std::uint64_t id, size_t maxBytes, std::string& head, size_t& length) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return false;
+    }
+
+    const Location& location = it->second;
+    int fd = ::open(segmentPath(location.segment).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    length = location.length;
+    head.resize(std::min(length, maxBytes));
+    bool ok = readAt(fd, &head[0], head.size(), location.offset + location.headerBytes);
+    ::close(fd);
+    return ok;
+}
+
+bool SegmentStore::scan(const RecordVisitor& visit) const {
+    std::vector<PendingRead> records;
+    std::map<std::uint32_t, int> fds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        records.reserve(index.size());
+        for (const auto& record : index) {
+            records.push_back({record.first, record.second});
+        }
+        if (!openSegmentsLocked(records, fds)) {
+            return false;
+        }
+    }
+    return readRecords(records, fds, visit);
+}
+
+bool SegmentStore::getMany(const std::vector<std::uint64_t>& ids, const RecordVisitor& visit) const {
+    std::vector<PendingRead> records;
+    std::map<std::uint32_t, int> fds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        records.reserve(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto it = index.find(ids[i]);
+            if (it == index.end()) {
+                return false;
+            }
+            records.push_back({i, it->second});
+        }
+        if (!openSegmentsLocked(records, fds)) {
+            return false;
+        }
+    }
+    return readRecords(records, fds, visit);
+}
+
+bool SegmentStore::openSegmentsLocked(const std::vector<PendingRead>& records, std::map<std::uint32_t, int>& fds) const {
+    // Opened under the lock: a compaction renaming a segment afterwards
+    // leaves these descriptors on the file the offsets were taken from
+    for (const auto& record : records) {
+        if (fds.count(record.location.segment) != 0) {
+            continue;
+        }
+        int fd = ::open(segmentPath(record.location.segment).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            for (const auto& open : fds) {
+                ::close(open.second);
+            }
+            fds.clear();
+            return false;
+        }
+        fds[record.location.segment] = fd;
+    }
+    return true;
+}
+
+bool SegmentStore::readRecords(std::vector<PendingRead>& records, std::map<std::uint32_t, int>& fds,
+                               const RecordVisitor& visit) const {
+    struct Batch {
+        int fd;
+        std::uint64_t offset;
+        std::uint64_t length;
+        size_t first;
+        size_t last;
+    };
+
+    // Read in file order, coalescing nearby records into buffer-sized batches
+    std::sort(records.begin(), records.end(), [](const PendingRead& a, const PendingRead& b) {
+        return a.location.segment != b.location.segment ? a.location.segment < b.location.segment
+                                                        : a.location.offset < b.location.offset;
+    });
+    std::vector<Batch> batches;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Location& location = records[i].location;
+        std::uint64_t end = location.offset + location.headerBytes + location.length;
+        if (!batches.empty()) {
+            Batch& batch = batches.back();
+            if (records[batch.first].location.segment == location.segment &&
+                location.offset <= batch.offset + batch.length + kMaxReadGap &&
+                end - batch.offset <= kScanBufferSize) {
+                batch.length = std::max(batch.length, end - batch.offset); // Ids may repeat
+                batch.last = i + 1;
+                continue;
+            }
+        }
+        batches.push_back({fds[location.segment], location.offset, end - location.offset, i, i + 1});
+    }
+
+    std::string buffers[kScanBuffers];
+    auto visitBatch = [&](size_t i) {
+        const std::string& buffer = buffers[i % kScanBuffers];
+        for (size_t r = batches[i].first; r < batches[i].last; ++r) {
+            const Location& location = records[r].location;
+            visit(records[r].tag, std::string_view(buffer).substr(
+                                      location.offset + location.headerBytes - batches[i].offset,
+                                      location.length));
+        }
+    };
+
+    // A single read has nothing to overlap with
+    if (batches.size() < 2) {
+        bool ok = true;
+        std::exception_ptr failure;
+        try {
+            if (!batches.empty()) {
+                buffers[0].resize(batches[0].length);
+                ok = readAt(batches[0].fd, &buffers[0][0], batches[0].length, batches[0].offset);
+                if (ok) {
+                    visitBatch(0);
+                }
+            }
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        for (const auto& open : fds) {
+            ::close(open.second);
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        return ok;
+    }
+
+    std::mutex scanMutex;
+    std::condition_variable scanSignal;
+    size_t readCount = 0;
+    size_t visitedCount = 0;
+    bool failed = false;
+    // An exception on either side stops both; it is rethrown after the join
+    std::exception_ptr readerFailure;
+    std::exception_ptr visitFailure;
+    auto stop = [&] {
+        {
+            std::lock_guard<std::mutex> lock(scanMutex);
+            failed = true;
+        }
+        scanSignal.notify_all();
+    };
+
+    std::thread reader([&] {
+        try {
+            for (size_t i = 0; i < batches.size(); ++i) {
+                {
+                    std::unique_lock<std::mutex> lock(scanMutex);
+                    scanSignal.wait(lock, [&] { return failed || i - visitedCount < kScanBuffers; });
+                    if (failed) {
+                        return;
+                    }
+                }
+                std::string& buffer = buffers[i % kScanBuffers];
+                buffer.resize(batches[i].length); // Keeps the capacity of earlier batches
+                bool ok = readAt(batches[i].fd, &buffer[0], batches[i].length, batches[i].offset);
+                {
+                    std::lock_guard<std::mutex> lock(scanMutex);
+                    failed = failed || !ok;
+                    ++readCount;
+                }
+                scanSignal.notify_all();
+            }
+        } catch (...) {
+            readerFailure = std::current_exception();
+            stop();
+        }
+    });
+
+    try {
+        for (size_t i = 0; i < batches.size(); ++i) {
+            {
+                std::unique_lock<std::mutex> lock(scanMutex);
+                scanSignal.wait(lock, [&] { return failed || readCount > i; });
+                if (failed) {
+                    break;
+                }
+            }
+            visitBatch(i);
+            {
+                std::lock_guard<std::mutex> lock(scanMutex);
+                ++visitedCount;
+            }
+            scanSignal.notify_all();
+        }
+    } catch (...) {
+        visitFailure = std::current_exception();
+        stop();
+    }
+
+    reader.join();
+    for (const auto& open : fds) {
+        ::close(open.second);
+    }
+    if (visitFailure || readerFailure) {
+        std::rethrow_exception(visitFailure ? visitFailure : readerFailure);
+    }
+    return !failed;
+}
+
+std::vector<std::uint64_t> SegmentStore::getIds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::uint64_t> ids;
+    ids.reserve(index.size());
+    for (const auto& record : index) {
+        ids.push_back(record.first);
+    }
+    return ids;
+}
+
+std::uint32_t SegmentStore::getSegment(std::uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(id);
+    return it != index.end() ? it->second.segment : 0;
+}
+
+size_t SegmentStore::getRecordCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return index.size();
+}
+
+std::uint64_t SegmentStore::getGeneration() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sequence;
+}
+
+void SegmentStore::setCompactionThreshold(double deadRatio) {
+    std::lock_guard<std::mutex> lock(mutex);
+    compactionThreshold = deadRatio;
+}
+
+void SegmentStore::setIoRateLimit(std::uint64_t bytesPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ioRateLimit = bytesPerSecond;
+}
+
+void SegmentStore::setMaxSegmentSize(std::uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maxSegmentSize = bytes;
+}
+
+void SegmentStore::startCompactor() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (compactorRunning) {
+        return;
+    }
+    compactorRunning = true;
+    compactor = std::thread(&SegmentStore::compactorLoop, this);
+}
+
+void SegmentStore::stopCompactor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!compactorRunning) {
+            return;
+        }
+        compactorRunning = false;
+    }
+    compactorSignal.notify_all();
+    compactor.join();
+}
+
+bool SegmentStore::compactSegment(std::uint32_t segment) {
+    // Only one rewrite at a time; sealed segments are otherwise immutable,
+    // so the file can be read and rewritten without holding the index lock.
+    std::lock_guard<std::mutex> compactionLock(compactionMutex);
+
+    bool olderExists;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (activeFd < 0 || segment == activeSegment || segments.count(segment) == 0) {
+            return false;
+        }
+        olderExists = segments.begin()->first < segment;
+    }
+
+    std::string path = segmentPath(segment);
+    std::uint64_t startNanos = nowNanos();
+    std::string data;
+    if (!readWholeFile(path, data)) {
+        return false;
+    }
+
+    struct Record {
+        RecordHeader header;
+        std::uint64_t offset;
+        std::uint64_t newOffset;
+        bool keep;
+    };
+    std::vector<Record> records;
+    RecordHeader header;
+    for (size_t offset = 0; offset < data.size() && parseRecord(data, offset, header);
+         offset += header.headerBytes + header.length + 1) {
+        records.push_back({header, offset, 0, false});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& record : records) {
+            auto it = index.find(record.header.id);
+            if (record.header.op == 'P') {
+                record.keep = it != index.end() && it->second.segment == segment &&
+                              it->second.offset == record.offset;
+            } else if (record.header.op == 'D') {
+                // A tombstone only matters while an older segment may still hold a put
+                record.keep = olderExists && it == index.end();
+            }
+        }
+    }
+
+    std::string tmpPath = directory + "/" + fs::path(path).stem().string() + ".compact";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string buffer;
+    std::uint64_t written = 0;
+    bool ok = true;
+    for (auto& record : records) {
+        if (!record.keep) {
+            continue;
+        }
+        record.newOffset = written + buffer.size();
+        buffer.append(data, record.offset, record.header.headerBytes + record.header.length + 1);
+        if (buffer.size() >= kCompactionBlockSize) {
+            ok = ok && writeAll(fd, buffer.data(), buffer.size());
+            written += buffer.size();
+            buffer.clear();
+            throttle(data.size() + written, startNanos);
+        }
+    }
+    ok = ok && writeAll(fd, buffer.data(), buffer.size()) && ::fdatasync(fd) == 0;
+    written += buffer.size();
+    ::close(fd);
+
+    std::error_code ec;
+    if (!ok) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (segments.count(segment) == 0) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    // Records superseded while the copy was being written are dead in the new file
+    std::uint64_t deadBytes = 0;
+    for (const auto& record : records) {
+        if (!record.keep || record.header.op != 'P') {
+            continue;
+        }
+        auto it = index.find(record.header.id);
+        if (it != index.end() && it->second.segment == segment && it->second.offset == record.offset) {
+            it->second.offset = record.newOffset;
+        } else {
+            deadBytes += record.header.headerBytes + record.header.length + 1;
+        }
+    }
+
+    if (written == 0) {
+        fs::remove(tmpPath, ec);
+        fs::remove(path, ec);
+        segments.erase(segment);
+    } else {
+        fs::rename(tmpPath, path, ec);
+        if (ec) {
+            fs::remove(tmpPath, ec);
+            return false;
+        }
+        segments[segment] = {written, deadBytes};
+    }
+    syncDirectory(directory);
+    return true;
+}
+
+std::vector<SegmentStore::SegmentStats> SegmentStore::getSegmentStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SegmentStats> stats;
+    for (const auto& segment : segments) {
+        stats.push_back({segment.first, segment.second.size, segment.second.deadBytes,
+                         segment.first == activeSegment});
+    }
+    return stats;
+}
+
+std::string SegmentStore::segmentPath(std::uint32_t segment) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06u.dat", segment);
+    return directory + "/" + name;
+}
+
+bool SegmentStore::replaySegment(std::uint32_t segment, bool last) {
+    std::string path = segmentPath(segment);
+    std::string data;
+    if (!readWholeFile(path, data)) {
+        return false;
+    }
+
+    Segment& stats = segments[segment];
+    stats = {0, 0};
+    RecordHeader header;
+    size_t offset = 0;
+    while (offset < data.size() && parseRecord(data, offset, header)) {
+        Location location = {segment, offset, header.headerBytes, header.length};
+        auto it = index.find(header.id);
+
+        if (header.op == 'P') {
+            if (it != index.end()) {
+                markDead(it->second);
+                it->second = location;
+            } else {
+                index.emplace(header.id, location);
+            }
+        } else if (header.op == 'D') {
+            if (it != index.end()) {
+                markDead(it->second);
+                index.erase(it);
+            }
+        } else {
+            stats.deadBytes += header.headerBytes + header.length + 1;
+        }
+
+        nextRecordId = std::max(nextRecordId, header.op == 'S' ? header.id : header.id + 1);
+        sequence = std::max(sequence, header.sequence);
+        offset += header.headerBytes + header.length + 1;
+        stats.size = offset;
+    }
+
+    if (offset < data.size()) {
+        // Only the segment being appended to can have a torn tail from an
+        // interrupted write. A bad record in a sealed one is corruption:
+        // truncating would silently drop every record after it.
+        if (!last) {
+            return false;
+        }
+        std::error_code ec;
+        fs::resize_file(path, offset, ec);
+        if (ec) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SegmentStore::unlock() {
+    if (lockFd >= 0) {
+        ::close(lockFd); // Releases the flock
+        lockFd = -1;
+    }
+}
+
+bool SegmentStore::openSegment(std::uint32_t segment) {
+    int fd = ::open(segmentPath(segment).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    activeFd = fd;
+    activeSegment = segment;
+
+    Segment& stats = segments[segment];
+    if (stats.size == 0) {
+        // Every segment starts with the current sequence and next record id
+        // so both survive compaction of the records that produced them
+        std::string record = formatHeader('S', nextRecordId, sequence, std::string()) + "\n";
+        if (!writeAll(fd, record.data(), record.size())) {
+            return false;
+        }
+        stats.size = record.size();
+        stats.deadBytes = record.size();
+        syncDirectory(directory);
+    }
+    return true;
+}
+
+bool SegmentStore::appendRecord(char op, std::uint64_t id, const std::string& payload, Location& location) {
+    if (segments[activeSegment].size >= maxSegmentSize) {
+        ::fdatasync(activeFd);
+        ::close(activeFd);
+        activeFd = -1;
+        if (!openSegment(activeSegment + 1)) {
+            return false;
+        }
+        compactorSignal.notify_all();
+    }
+
+    std::string header = formatHeader(op, id, sequence + 1, payload);
+    std::uint32_t headerBytes = static_cast<std::uint32_t>(header.size());
+
+    Segment& stats = segments[activeSegment];
+    if (!writeRecord(activeFd, header, payload)) {
+        // Never leave a partial record in front of the next append
+        if (::ftruncate(activeFd, static_cast<off_t>(stats.size)) != 0) {
+            ::close(activeFd);
+            activeFd = -1;
+        }
+        return false;
+    }
+
+    ++sequence;
+    location = {activeSegment, stats.size, headerBytes, static_cast<std::uint32_t>(payload.size())};
+    stats.size += headerBytes + payload.size() + 1;
+    return true;
+}
+
+void SegmentStore::markDead(const Location& location) {
+    auto it = segments.find(location.segment);
+    if (it == segments.end()) {
+        return;
+    }
+
+    Segment& stats = it->second;
+    stats.deadBytes += location.headerBytes + location.length + 1;
+    if (compactorRunning && location.segment != activeSegment &&
+        stats.deadBytes >= compactionThreshold * stats.size) {
+        compactorSignal.notify_all();
+    }
+}
+
+void SegmentStore::compactorLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (compactorRunning) {
+        compactorSignal.wait_for(lock, std::chrono::seconds(2));
+
+        std::vector<std::uint32_t> candidates;
+        for (const auto& segment : segments) {
+            const Segment& stats = segment.second;
+            if (segment.first != activeSegment && stats.size > 0 &&
+                stats.deadBytes >= compactionThreshold * stats.size) {
+                candidates.push_back(segment.first);
+            }
+        }
+
+        for (std::uint32_t segment : candidates) {
+            if (!compactorRunning) {
+                break;
+            }
+            lock.unlock();
+            compactSegment(segment);
+            lock.lock();
+        }
+    }
+}
+
+void SegmentStore::throttle(std::uint64_t bytesDone, std::uint64_t startNanos) const {
+    std::uint64_t rateLimit;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rateLimit = ioRateLimit;
+    }
+    if (rateLimit == 0) {
+        return;
+    }
+
+    std::uint64_t targetNanos = bytesDone * 1000000000ull / rateLimit;
+    std::uint64_t elapsed = nowNanos() - startNanos;
+    if (targetNanos > elapsed) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(targetNanos - elapsed));
+    }
+}
@@ -9,21 +9,22 @@ User::User(const std::string& username, const std::string& password)
     : username(username), isLoggedIn(false) {
     salt = generateSalt();
     passwordHash = hashPassword(password, salt);
-    generateEncryptionKey();
+    SecureString key;
+    deriveKey(password, "", key);
+    wrapKey(password, key);
 }
 
 bool User::login(const std::string& password) {
-    if (verifyPassword(password)) {
-        isLoggedIn = true;
-        generateEncryptionKey();
-        return true;
+    if (!verifyPassword(password) || !unwrapKey(password, encryptionKey)) {
+        return false;
     }
-    return false;
+    isLoggedIn = true;
+    return true;
 }
 
 void User::logout() {
     isLoggedIn = false;
-    encryptionKey.clear();
+    SecureString().swap(encryptionKey); // Releasing the buffer zeroes it
 }
 
 bool User::changePassword(const std::string& oldPassword, const std::string& newPassword) {
@@ -31,9 +32,18 @@ bool User::changePassword(const std::string& oldPassword, const std::string& new
         return false;
     }
     
+    // Everything on disk is encrypted with the data key, so it stays the
+    // same; only its wrapping follows the new password
+    SecureString key;
+    if (!unwrapKey(oldPassword, key)) {
+        return false;
+    }
     salt = generateSalt();
     passwordHash = hashPassword(newPassword, salt);
-    generateEncryptionKey();
+    wrapKey(newPassword, key);
+    if (isLoggedIn) {
+        encryptionKey.swap(key);
+    }
     return true;
 }
 
@@ -45,7 +55,7 @@ std::string User::getUsername() const {
     return username;
 }
 
-std::string User::getEncryptionKey() const {
+const SecureString& User::getEncryptionKey() const {
     return encryptionKey;
 }
 
@@ -60,8 +70,12 @@ std::string User::generateSalt() {
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(0, 255);
     
+    // Hex digits: user.dat is line based, so a raw byte could end the salt early
+    const char digits[] = "0123456789abcdef";
     for (int i = 0; i < saltLength; ++i) {
-        salt += static_cast<char>(dis(gen));
+        int byte = dis(gen);
+        salt += digits[byte >> 4];
+        salt += digits[byte & 15];
     }
     
     return salt;
@@ -71,7 +85,8 @@ std::string User::serialize() const {
     std::stringstream ss;
     ss << username << "\n"
        << passwordHash << "\n"
-       << salt;
+       << salt << "\n"
+       << wrappedKey;
     return ss.str();
 }
 
@@ -82,14 +97,37 @@ User User::deserialize(const std::string& data) {
     std::getline(ss, user.username);
     std::getline(ss, user.passwordHash);
     std::getline(ss, user.salt);
+    std::getline(ss, user.wrappedKey); // Absent in files from before key wrapping
     
     return user;
 }
 
-void User::generateEncryptionKey() {
-    if (isLoggedIn) {
-        encryptionKey = Encryption::generateKey(username + passwordHash);
+void User::deriveKey(const std::string& password, const char* purpose, SecureString& key) const {
+    SecureString material(username.data(), username.size());
+    material.append(":").append(password.data(), password.size()).append(":").append(salt.data(), salt.size());
+    material.append(purpose);
+    std::string digest = Encryption::hashString(material);
+    key.assign(digest.data(), digest.size());
+    scrub(digest);
+}
+
+bool User::unwrapKey(const std::string& password, SecureString& key) const {
+    if (wrappedKey.empty()) {
+        // Accounts from before key wrapping used the derived key directly;
+        // it becomes their data key and is wrapped on the next password change
+        deriveKey(password, "", key);
+        return true;
     }
+    SecureString wrapping;
+    deriveKey(password, ":wrap", wrapping);
+    key = Encryption::decrypt(wrappedKey, wrapping);
+    return key.size() == 2 * 32; // Hex SHA-256
+}
+
+void User::wrapKey(const std::string& password, const SecureString& key) {
+    SecureString wrapping;
+    deriveKey(password, ":wrap", wrapping);
+    wrappedKey = Encryption::encrypt(key, wrapping);
 }
 
 bool User::verifyPassword(const std::string& password) const {
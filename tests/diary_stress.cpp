@@ -0,0 +1,545 @@
+// Randomized stress test for Diary. Worker threads run a mix of add, update,
+// delete, lookup, search and history operations, checking every result
+// against a reference model. Diary calls are serialized by one mutex (Diary
+// is not internally synchronized); what runs concurrently is everything
+// around them: the store compactors, the parallel load pipeline on re-login,
+// the body cache, the secure memory pool, and entry encryption, compression
+// and serialization done by the workers outside the lock.
+//
+// Usage: diary_stress [--threads N] [--ops N] [--seed N] [--dir PATH] [--perf]
+// The diary lives in a fresh temporary directory unless --dir names one,
+// which must be empty or left by an earlier run; it is deleted at exit.
+// --perf reports cycles and cache misses per operation type where
+// perf_event_open is available.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Diary.hpp"
+#include "../include/Entry.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum Op { Add, Update, Delete, Get, Keyword, Tag, History, RoundTrip, Reload, OpCount };
+
+const char* const kOpNames[OpCount] = {"add", "update", "delete", "get", "keyword", "tag", "history",
+                                       "roundtrip", "reload"};
+
+const size_t kMaxEntriesPerThread = 120;
+const size_t kReloadInterval = 400;      // Operations between full logout/login checks
+const size_t kMemoryBudget = 64 * 1024;  // Small enough that bodies are evicted and read back
+const char* const kMarkerFile = ".diary_stress"; // Marks directories this harness created
+
+struct Options {
+    size_t threads = 4;
+    size_t ops = 500;
+    std::uint64_t seed = 1;
+    std::string directory; // Empty for a fresh temporary directory
+    bool perf = false;
+};
+
+struct ModelEntry {
+    std::string content;
+    std::string tags;
+    std::vector<std::string> history; // Earlier contents, oldest first
+};
+
+struct OpStats {
+    std::uint64_t count = 0;
+    std::uint64_t nanos = 0;
+    std::uint64_t cycles = 0;
+    std::uint64_t cacheMisses = 0;
+};
+
+// Per-thread hardware counters, read around each operation
+class PerfCounters {
+private:
+    int cyclesFd = -1;
+    int missesFd = -1;
+
+public:
+    PerfCounters() = default;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() { close(); }
+
+    bool open(std::string& error) {
+#ifdef __linux__
+        cyclesFd = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+        missesFd = cyclesFd < 0 ? -1 : openCounter(PERF_COUNT_HW_CACHE_MISSES, cyclesFd);
+        if (cyclesFd < 0 || missesFd < 0) {
+            error = std::strerror(errno);
+            close();
+            return false;
+        }
+        ioctl(cyclesFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(cyclesFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        error = "perf_event_open is Linux only";
+        return false;
+#endif
+    }
+
+    bool isOpen() const { return cyclesFd >= 0; }
+
+    // Cycles and cache misses so far, read together from the group
+    bool read(std::uint64_t& cycles, std::uint64_t& misses) const {
+#ifdef __linux__
+        std::uint64_t values[3] = {0, 0, 0}; // Count, then one value per counter
+        if (!isOpen() || ::read(cyclesFd, values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+            return false;
+        }
+        cycles = values[1];
+        misses = values[2];
+        return true;
+#else
+        (void)cycles;
+        (void)misses;
+        return false;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    static int openCounter(std::uint64_t config, int groupFd) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = groupFd < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+#endif
+
+    void close() {
+#ifdef __linux__
+        if (missesFd >= 0) {
+            ::close(missesFd);
+        }
+        if (cyclesFd >= 0) {
+            ::close(cyclesFd);
+        }
+#endif
+        cyclesFd = missesFd = -1;
+    }
+};
+
+class StressRun {
+private:
+    Options options;
+    Diary diary;
+    std::mutex mutex; // Guards diary, model and failures
+    std::map<std::string, ModelEntry> model;
+    std::vector<std::string> failures;
+    std::atomic<size_t> opsDone{0};
+    std::vector<std::vector<OpStats>> stats; // Per thread, per op
+
+public:
+    explicit StressRun(const Options& options)
+        : options(options), diary(options.directory), stats(options.threads, std::vector<OpStats>(OpCount)) {}
+
+    bool setUp() {
+        if (!diary.registerUser("stress", "stress-password") || !diary.loginUser("stress", "stress-password")) {
+            std::fprintf(stderr, "Could not register and log in under %s\n", options.directory.c_str());
+            return false;
+        }
+        diary.setMemoryBudget(kMemoryBudget);
+        return true;
+    }
+
+    void run() {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < options.threads; ++t) {
+            workers.emplace_back([this, t] { work(t); });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        reloadAndVerify();
+        diary.logoutUser();
+    }
+
+    bool report() const {
+        std::printf("%-10s %10s %12s %14s %14s\n", "op", "count", "avg ns", "avg cycles", "avg misses");
+        for (size_t op = 0; op < OpCount; ++op) {
+            OpStats total;
+            for (const auto& thread : stats) {
+                total.count += thread[op].count;
+                total.nanos += thread[op].nanos;
+                total.cycles += thread[op].cycles;
+                total.cacheMisses += thread[op].cacheMisses;
+            }
+            if (total.count == 0) {
+                continue;
+            }
+            std::printf("%-10s %10llu %12llu", kOpNames[op], static_cast<unsigned long long>(total.count),
+                        static_cast<unsigned long long>(total.nanos / total.count));
+            if (options.perf && total.cycles > 0) {
+                std::printf(" %14llu %14llu", static_cast<unsigned long long>(total.cycles / total.count),
+                            static_cast<unsigned long long>(total.cacheMisses / total.count));
+            }
+            std::printf("\n");
+        }
+
+        for (size_t i = 0; i < failures.size() && i < 20; ++i) {
+            std::fprintf(stderr, "FAIL: %s\n", failures[i].c_str());
+        }
+        if (!failures.empty()) {
+            std::fprintf(stderr, "%zu check(s) failed\n", failures.size());
+        }
+        return failures.empty();
+    }
+
+private:
+    void work(size_t thread) {
+        std::mt19937_64 rng(options.seed * 1000003 + thread);
+        std::vector<std::string> titles; // Owned by this thread; other threads never touch them
+        size_t nextTitle = 0;
+        PerfCounters counters;
+        std::string perfError;
+        if (options.perf && !counters.open(perfError) && thread == 0) {
+            std::fprintf(stderr, "perf counters unavailable (%s); reporting time only\n", perfError.c_str());
+        }
+
+        for (size_t i = 0; i < options.ops; ++i) {
+            Op op = pickOp(rng, titles.size());
+            std::string title;
+            if (op == Add) {
+                title = "t" + std::to_string(thread) + "-" + std::to_string(nextTitle++);
+            } else if (!titles.empty() && op != Keyword && op != Tag && op != RoundTrip && op != Reload) {
+                title = titles[rng() % titles.size()];
+            }
+
+            // Inputs are built before taking the lock, so threads overlap here
+            std::string content = makeText(rng, 20 + rng() % 400);
+            std::string tags = "tag" + std::to_string(rng() % 8);
+            std::string keyword = makeWord(rng).substr(0, 3);
+
+            // Measured once the lock is held, so waiting for it is not counted
+            std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+            if (op != RoundTrip) {
+                lock.lock();
+            }
+            std::uint64_t startCycles = 0;
+            std::uint64_t startMisses = 0;
+            bool counted = counters.read(startCycles, startMisses);
+            auto start = std::chrono::steady_clock::now();
+
+            if (op == RoundTrip) {
+                roundTrip("roundtrip-" + std::to_string(thread), content, tags);
+            } else {
+                apply(op, title, content, tags, keyword, rng, titles);
+            }
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            OpStats& opStats = stats[thread][op];
+            ++opStats.count;
+            opStats.nanos += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            std::uint64_t endCycles = 0;
+            std::uint64_t endMisses = 0;
+            if (counted && counters.read(endCycles, endMisses)) {
+                opStats.cycles += endCycles - startCycles;
+                opStats.cacheMisses += endMisses - startMisses;
+            }
+            lock = std::unique_lock<std::mutex>();
+            ++opsDone;
+        }
+    }
+
+    Op pickOp(std::mt19937_64& rng, size_t owned) {
+        if (owned == 0) {
+            return Add;
+        }
+        unsigned roll = static_cast<unsigned>(rng() % 100);
+        if (roll < 25) {
+            return owned < kMaxEntriesPerThread ? Add : Delete;
+        }
+        if (roll < 45) return Update;
+        if (roll < 52) return Delete;
+        if (roll < 65) return Get;
+        if (roll < 75) return Keyword;
+        if (roll < 82) return Tag;
+        if (roll < 90) return History;
+        if (roll < 99) return RoundTrip;
+        return Reload;
+    }
+
+    // Runs one operation on the diary and the model; the caller holds the lock
+    void apply(Op op, const std::string& title, const std::string& content, const std::string& tags,
+               const std::string& keyword, std::mt19937_64& rng, std::vector<std::string>& titles) {
+        switch (op) {
+            case Add: {
+                Entry entry(title, content);
+                entry.setTags(tags);
+                check(diary.addEntry(entry), "addEntry " + title);
+                model[title] = {content, tags, {}};
+                titles.push_back(title);
+                break;
+            }
+            case Update: {
+                ModelEntry& expected = model[title];
+                Entry* current = diary.getEntry(title);
+                if (!check(current != nullptr, "getEntry before update " + title)) {
+                    break;
+                }
+                Entry updated = *current;
+                updated.setContent(content);
+                updated.setTags(tags);
+                check(diary.updateEntry(title, updated), "updateEntry " + title);
+                expected.history.push_back(expected.content);
+                expected.content = content;
+                expected.tags = tags;
+                break;
+            }
+            case Delete: {
+                check(diary.deleteEntry(title), "deleteEntry " + title);
+                check(diary.getEntry(title) == nullptr, "deleted entry still found " + title);
+                model.erase(title);
+                titles.erase(std::find(titles.begin(), titles.end(), title));
+                break;
+            }
+            case Get: {
+                Entry* entry = diary.getEntry(title);
+                const ModelEntry& expected = model[title];
+                check(entry != nullptr && entry->getContent() == expected.content && entry->getTags() == expected.tags,
+                      "getEntry content " + title);
+                break;
+            }
+            case Keyword: {
+                std::vector<Entry> results = diary.searchByKeyword(keyword);
+                size_t expected = 0;
+                for (const auto& item : model) {
+                    expected += item.first.find(keyword) != std::string::npos ||
+                                item.second.content.find(keyword) != std::string::npos;
+                }
+                check(results.size() == expected, "searchByKeyword count for '" + keyword + "'");
+                for (const auto& result : results) {
+                    auto it = model.find(result.getTitle());
+                    check(it != model.end() && result.getContent() == it->second.content,
+                          "searchByKeyword result " + result.getTitle());
+                }
+                break;
+            }
+            case Tag: {
+                std::string tag = "tag" + std::to_string(rng() % 8);
+                std::vector<Entry> results = diary.searchByTag(tag);
+                size_t expected = 0;
+                for (const auto& item : model) {
+                    expected += item.second.tags.find(tag) != std::string::npos;
+                }
+                check(results.size() == expected, "searchByTag count for " + tag);
+                for (const auto& result : results) {
+                    check(result.getTags().find(tag) != std::string::npos, "searchByTag result " + result.getTitle());
+                }
+                break;
+            }
+            case History: {
+                const ModelEntry& expected = model[title];
+                std::vector<RevisionStore::Revision> revisions = diary.listRevisions(title);
+                if (!check(revisions.size() == expected.history.size(), "listRevisions count " + title) ||
+                    revisions.empty()) {
+                    break;
+                }
+                std::uint32_t number = static_cast<std::uint32_t>(1 + rng() % revisions.size());
+                Entry revision;
+                check(diary.getRevision(title, number, revision) &&
+                          revision.getContent() == expected.history[number - 1],
+                      "getRevision " + title + " #" + std::to_string(number));
+                break;
+            }
+            case Reload:
+                reloadAndVerify();
+                break;
+            default:
+                break;
+        }
+
+        if (opsDone % kReloadInterval == kReloadInterval - 1) {
+            reloadAndVerify();
+        }
+    }
+
+    // Logs out and back in, so entries are read back through the load
+    // pipeline, then compares every entry with the model
+    void reloadAndVerify() {
+        diary.logoutUser();
+        if (!check(diary.loginUser("stress", "stress-password"), "login after logout")) {
+            return;
+        }
+        diary.setMemoryBudget(kMemoryBudget);
+
+        std::vector<Entry> all = diary.getAllEntries();
+        check(all.size() == model.size() && diary.getEntryCount() == model.size(), "entry count after reload");
+        for (const auto& entry : all) {
+            auto it = model.find(entry.getTitle());
+            check(it != model.end() && entry.getContent() == it->second.content && entry.getTags() == it->second.tags,
+                  "entry after reload " + entry.getTitle());
+        }
+    }
+
+    // Entry encryption, compression and serialization, run concurrently
+    // with the other workers
+    void roundTrip(const std::string& title, const std::string& content, const std::string& tags) {
+        const std::string key = "stress-key-" + title;
+        Entry entry(title, content);
+        entry.setTags(tags);
+        entry.encrypt(key);
+        Entry copy = Entry::deserialize(entry.serialize());
+        copy.decrypt(key);
+        if (copy.isEncrypted() || copy.getContent() != content || copy.getTitle() != title || copy.getTags() != tags) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures.push_back("entry round trip " + title);
+        }
+    }
+
+    bool check(bool condition, const std::string& what) {
+        if (!condition) {
+            failures.push_back(what);
+        }
+        return condition;
+    }
+
+    static std::string makeWord(std::mt19937_64& rng) {
+        std::string word;
+        size_t length = 3 + rng() % 6;
+        for (size_t i = 0; i < length; ++i) {
+            word += static_cast<char>('a' + rng() % 12); // Small alphabet, so searches find matches
+        }
+        return word;
+    }
+
+    static std::string makeText(std::mt19937_64& rng, size_t words) {
+        std::string text;
+        for (size_t i = 0; i < words; ++i) {
+            text += makeWord(rng);
+            text += ' ';
+        }
+        return text;
+    }
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) {
+            options.threads = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--ops" && hasValue) {
+            options.ops = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--dir" && hasValue) {
+            options.directory = argv[++i];
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--threads N] [--ops N] [--seed N] [--dir PATH] [--perf]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool makeTemporaryDirectory(std::string& directory) {
+    std::error_code ec;
+    fs::path base = fs::temp_directory_path(ec);
+    if (ec) {
+        return false;
+    }
+#ifndef _WIN32
+    std::string pattern = (base / "diary_stress.XXXXXX").string();
+    if (mkdtemp(&pattern[0]) == nullptr) {
+        return false;
+    }
+    directory = pattern;
+    return true;
+#else
+    std::random_device random;
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        fs::path candidate = base / ("diary_stress." + std::to_string(random()));
+        if (fs::create_directory(candidate, ec)) {
+            directory = candidate.string();
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+// The run deletes its directory afterwards, so it only takes one it may
+// delete: a new one, an empty one, or one marked by an earlier run
+bool prepareDirectory(Options& options) {
+    std::error_code ec;
+    if (options.directory.empty()) {
+        if (!makeTemporaryDirectory(options.directory)) {
+            std::fprintf(stderr, "Could not create a temporary directory\n");
+            return false;
+        }
+    } else if (fs::exists(options.directory, ec) && !fs::is_empty(options.directory, ec)) {
+        if (!fs::exists(fs::path(options.directory) / kMarkerFile, ec)) {
+            std::fprintf(stderr, "%s is not empty and was not created by diary_stress\n",
+                         options.directory.c_str());
+            return false;
+        }
+        fs::remove_all(options.directory, ec); // Left by an interrupted run
+    }
+    fs::create_directories(options.directory, ec);
+    std::ofstream marker(fs::path(options.directory) / kMarkerFile);
+    return static_cast<bool>(marker);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    if (!prepareDirectory(options)) {
+        return 2;
+    }
+    std::printf("diary_stress: %zu threads x %zu ops, seed %llu\n", options.threads, options.ops,
+                static_cast<unsigned long long>(options.seed));
+
+    bool passed = false;
+    {
+        StressRun run(options);
+        if (run.setUp()) {
+            run.run();
+            passed = run.report();
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(options.directory, ec);
+    std::printf("%s\n", passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+// Throughput of Entry::deserialize against the stringstream parser it
+// replaced, on one serialized record parsed over and over.
+//
+// Usage: entry_parse_bench [--size BYTES] [--iterations N]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../include/Entry.hpp"
+
+namespace {
+
+struct Options {
+    size_t size = 4096;
+    size_t iterations = 200000;
+};
+
+// The fields the previous parser produced, filled the way it filled them
+struct LegacyRecord {
+    std::string title;
+    std::time_t timestamp = 0;
+    std::string tags;
+    bool encrypted = false;
+    int codec = 0;
+    std::vector<std::string> chunks;
+    std::string content;
+};
+
+LegacyRecord legacyDeserialize(const std::string& data) {
+    std::stringstream ss(data);
+    LegacyRecord record;
+
+    std::getline(ss, record.title);
+    ss >> record.timestamp;
+    ss.ignore(); // Skip newline
+    std::getline(ss, record.tags);
+    std::string flags;
+    std::getline(ss, flags);
+    std::stringstream flagStream(flags);
+    size_t chunkCount = 0;
+    flagStream >> record.encrypted >> record.codec >> chunkCount;
+    record.chunks.resize(chunkCount);
+    for (auto& chunk : record.chunks) {
+        std::getline(ss, chunk);
+    }
+    std::getline(ss, record.content, '\0'); // Read until the end
+    return record;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (arg == "--size") {
+            options.size = std::stoul(argv[++i]);
+        } else if (arg == "--iterations") {
+            options.iterations = std::stoul(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return options.iterations > 0;
+}
+
+// Runs `parse` over the record and prints its throughput. The returned
+// sizes are summed so the work cannot be optimized away.
+template <typename Parse>
+void measure(const char* name, const std::string& record, size_t iterations, Parse parse) {
+    std::uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += parse(record);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double bytes = static_cast<double>(record.size()) * static_cast<double>(iterations);
+    std::printf("%-12s %8.2f GB/s  %8.1f ns/record  (%llu)\n", name, bytes / seconds / 1e9,
+                seconds * 1e9 / static_cast<double>(iterations), static_cast<unsigned long long>(sink));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: entry_parse_bench [--size BYTES] [--iterations N]\n");
+        return 2;
+    }
+
+    std::string content;
+    while (content.size() < options.size) {
+        content += "Walked to the market, bought bread and wrote for an hour.\n";
+    }
+    content.resize(options.size);
+    Entry entry("Thursday", content);
+    entry.setTags("home,writing");
+    std::string record = entry.serialize();
+
+    std::printf("%zu byte record, %zu iterations\n", record.size(), options.iterations);
+    measure("stringstream", record, options.iterations, [](const std::string& data) {
+        return legacyDeserialize(data).content.size();
+    });
+    measure("string_view", record, options.iterations, [](const std::string& data) {
+        return Entry::deserialize(data).getContent().size();
+    });
+    return 0;
+}